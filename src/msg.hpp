@@ -141,28 +141,9 @@ struct Request
 	};
 
 	inline Request() {}
-	Request(const Request & other)
-		: type(other.type)
-		, seq(other.seq)
-		, account_id(other.account_id)
-		, req_id(other.req_id)
-	{
-		switch(other.type)
-		{
-			case Request::Type::NewOrder        : new_order         = other.new_order        ; break;
-			case Request::Type::End             :                                              break;
-		}
-	}
-
-	Request & operator=(const Request & other)
-	{
-		type       = other.type      ;
-		seq        = other.seq       ;
-		account_id = other.account_id;
-		req_id     = other.req_id    ;
-		new_order  = other.new_order ;
-		return *this;
-	}
+	// trivially copyable, it crosses shm:// as is
+	Request(const Request & other) = default;
+	Request & operator=(const Request & other) = default;
 
 	template<typename Serializer>
 	void serialize(Serializer && s) const
@@ -0,0 +1,100 @@
+#include <string>
+#include <vector>
+#include <memory_resource>
+
+#include <utttil/arena.hpp>
+#include <utttil/string_list.hpp>
+#include <utttil/dfloat.hpp>
+#include <utttil/assert.hpp>
+
+bool test_basics()
+{
+	utttil::arena a(1024);
+
+	char * c = (char*) a.allocate(1, 1);
+	std::uint64_t * u = (std::uint64_t*) a.allocate(sizeof(std::uint64_t), alignof(std::uint64_t));
+	ASSERT_ACT((std::uintptr_t)u % alignof(std::uint64_t), ==, 0ull, return false);
+	ASSERT_ACT((char*)u - c, <, 16, return false);
+	ASSERT_ACT(a.chunks.size(), ==, 1ull, return false);
+
+	// spills over to a second chunk
+	for (int i=0 ; i<200 ; i++)
+		a.make<std::uint64_t>(i);
+	ASSERT_ACT(a.chunks.size(), ==, 2ull, return false);
+
+	// bigger than a chunk
+	void * big = a.allocate(4096);
+	ASSERT_ACT(big, !=, nullptr, return false);
+	ASSERT_ACT(a.chunks.size(), ==, 3ull, return false);
+	ASSERT_ACT(a.capacity(), ==, 2048ull + 4096 + 16, return false);
+
+	// reset keeps the regular chunks and hands out the same memory again
+	a.reset();
+	ASSERT_ACT(a.allocated(), ==, 0ull, return false);
+	ASSERT_ACT(a.chunks.size(), ==, 2ull, return false);
+	ASSERT_ACT((char*) a.allocate(1, 1), ==, c, return false);
+	for (int i=0 ; i<200 ; i++)
+		a.make<std::uint64_t>(i);
+	ASSERT_ACT(a.chunks.size(), ==, 2ull, return false);
+
+	a.release();
+	ASSERT_ACT(a.capacity(), ==, 0ull, return false);
+
+	return true;
+}
+
+bool test_pmr()
+{
+	utttil::arena a;
+	utttil::arena_resource r(a);
+
+	for (int round=0 ; round<10 ; round++, a.reset())
+	{
+		std::pmr::vector<std::pmr::string> v(&r);
+		for (int i=0 ; i<100 ; i++)
+			v.emplace_back(std::string(30, 'a'+i%26));
+		ASSERT_ACT(v[99], ==, std::pmr::string(30, 'a'+99%26), return false);
+
+		utttil::pmr::string_list sl(&r);
+		sl << 123 << std::string("abc");
+		ASSERT_ACT(sl.front(), ==, "123", return false);
+		ASSERT_ACT(sl.back(), ==, "abc", return false);
+	}
+	// a steady state stays within the chunks of the first round
+	size_t capacity = a.capacity();
+	{
+		std::pmr::vector<std::pmr::string> v(&r);
+		for (int i=0 ; i<100 ; i++)
+			v.emplace_back(std::string(30, 'x'));
+	}
+	ASSERT_ACT(a.capacity(), ==, capacity, return false);
+
+	return true;
+}
+
+bool test_dfloat_to_string()
+{
+	using df = utttil::dfloat<int64_t, 5>;
+	utttil::arena a;
+	utttil::arena_resource r(a);
+
+	ASSERT_ACT(df(15, 1).to_string(), ==, "1.5", return false);
+	ASSERT_ACT(df(-5, 2).to_string(), ==, "-0.05", return false);
+	ASSERT_ACT(df(1200, 2).to_string(), ==, "12", return false);
+	ASSERT_ACT(df(0, 0).to_string(), ==, "0", return false);
+	ASSERT_ACT(df(15, 1).to_string(&r), ==, "1.5", return false);
+	ASSERT_ACT(a.allocated(), ==, 0ull, return false); // short string
+
+	return true;
+}
+
+int main()
+{
+	bool success = true
+		&& test_basics()
+		&& test_pmr()
+		&& test_dfloat_to_string()
+		;
+
+	return success ? 0 : 1;
+}
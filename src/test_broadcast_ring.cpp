@@ -0,0 +1,144 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+
+#include <utttil/broadcast_ring.hpp>
+#include <utttil/assert.hpp>
+
+bool test_readers()
+{
+	utttil::broadcast_ring<std::string> rb(2);
+
+	ASSERT_ACT(rb.capacity(), ==, 4ull, return false);
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+
+	auto early = rb.make_reader();
+	rb.push_back("a");
+	rb.push_back("b");
+	auto late = rb.make_reader();
+	rb.emplace_back("c");
+
+	ASSERT_ACT(early.size(), ==, 3ull, return false);
+	ASSERT_ACT(late .size(), ==, 1ull, return false);
+	ASSERT_ACT(early.front(), ==, std::string("a"), return false);
+	early.pop_front();
+	ASSERT_ACT(early.front(), ==, std::string("b"), return false);
+	ASSERT_ACT(late .front(), ==, std::string("c"), return false);
+	late.pop_front();
+	ASSERT_ACT(late.empty(), ==, true, return false);
+
+	// the writer doesn't wait for early
+	for (const char * s : {"d", "e", "f", "g"})
+		rb.push_back(s);
+	ASSERT_ACT(rb.begin(), ==, 3ull, return false);
+	ASSERT_ACT(rb.end()  , ==, 7ull, return false);
+	ASSERT_ACT(rb.at(3), ==, std::string("d"), return false);
+	ASSERT_ACT(late.front(), ==, std::string("d"), return false);
+
+	bool thrown = false;
+	try {
+		early.front();
+	} catch (utttil::broadcast_ring_overrun & e) {
+		thrown = true;
+		ASSERT_ACT(e.lost_begin, ==, 1ull, return false);
+		ASSERT_ACT(e.lost_end  , ==, 3ull, return false);
+	}
+	ASSERT_ACT(thrown, ==, true, return false);
+	// resumes at the oldest available
+	ASSERT_ACT(early.front(), ==, std::string("d"), return false);
+
+	auto replay = rb.make_reader(rb.begin());
+	ASSERT_ACT(replay.size(), ==, 4ull, return false);
+
+	return true;
+}
+
+bool test_try_pop_front()
+{
+	utttil::broadcast_ring<int> rb(2);
+	auto r = rb.make_reader();
+
+	int v = -1;
+	ASSERT_ACT(r.try_pop_front(v), ==, false, return false);
+	rb.push_back(1);
+	rb.push_back(2);
+	ASSERT_ACT(r.try_pop_front(v), ==, true, return false);
+	ASSERT_ACT(v, ==, 1, return false);
+	for (int i=3 ; i<10 ; i++)
+		rb.push_back(i);
+	bool thrown = false;
+	try {
+		r.try_pop_front(v);
+	} catch (utttil::broadcast_ring_overrun & e) {
+		thrown = true;
+		ASSERT_ACT(e.lost_begin, ==, 1ull, return false);
+		ASSERT_ACT(e.lost_end  , ==, 5ull, return false);
+	}
+	ASSERT_ACT(thrown, ==, true, return false);
+	ASSERT_ACT(r.try_pop_front(v), ==, true, return false);
+	ASSERT_ACT(v, ==, 6, return false);
+	return true;
+}
+
+// readers on other threads never see a torn element, and account for
+// everything as either read or lost
+bool test_thread_safety_fuzz()
+{
+	struct pair { size_t a, b; };
+	const size_t total = 1000000;
+	const int reader_count = 3;
+	utttil::broadcast_ring<pair> rb(6);
+
+	std::atomic<bool> success = true;
+	std::atomic<int> ready = 0;
+	std::vector<std::thread> readers;
+	for (int i=0 ; i<reader_count ; i++)
+		readers.emplace_back([&]()
+			{
+				auto r = rb.make_reader(0);
+				ready++;
+				size_t next = 0;
+				pair p;
+				while (next < total)
+				{
+					try {
+						if ( ! r.try_pop_front(p))
+							continue;
+						if (p.a != next || p.b != next)
+							success = false;
+						next++;
+					} catch (utttil::broadcast_ring_overrun & e) {
+						if (e.lost_begin != next)
+							success = false;
+						next = e.lost_end;
+					}
+				}
+			});
+	while (ready != reader_count)
+		std::this_thread::yield();
+
+	for (size_t i=0 ; i<total ; i++)
+	{
+		pair & p = rb.back();
+		p.a = i;
+		p.b = i;
+		rb.advance_back();
+	}
+	for (auto & t : readers)
+		t.join();
+
+	ASSERT_ACT(success.load(), ==, true, return false);
+	return true;
+}
+
+int main()
+{
+	bool success = true
+		&& test_readers()
+		&& test_try_pop_front()
+		&& test_thread_safety_fuzz()
+		;
+
+	return success ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+
+#include <utttil/concurrent_pool.hpp>
+#include <utttil/ring_buffer.hpp>
+#include <utttil/assert.hpp>
+
+bool test_basics()
+{
+	utttil::concurrent_pool<std::string, 8> pool(20);
+
+	ASSERT_ACT(pool.capacity(), ==, 20ull, return false);
+
+	std::vector<std::string*> ptrs;
+	for (int i=0 ; i<20 ; i++)
+	{
+		std::string * s = pool.alloc(std::to_string(i));
+		ASSERT_MSG_ACT(s, !=, nullptr, std::to_string(i), return false);
+		ASSERT_ACT(pool.contains(s), ==, true, return false);
+		ptrs.push_back(s);
+	}
+	ASSERT_ACT(pool.alloc(), ==, nullptr, return false);
+	for (int i=0 ; i<20 ; i++)
+		ASSERT_ACT(*ptrs[i], ==, std::to_string(i), return false);
+
+	// more than a magazine, some go back to the shared list
+	for (int i=0 ; i<20 ; i++)
+		pool.free(ptrs[i]);
+	ptrs.clear();
+	for (int i=0 ; i<20 ; i++)
+		ASSERT_MSG_ACT(pool.alloc(3, 'x'), !=, nullptr, std::to_string(i), return false);
+	ASSERT_ACT(pool.alloc(), ==, nullptr, return false);
+
+	std::string other;
+	ASSERT_ACT(pool.contains(&other), ==, false, return false);
+
+	return true;
+}
+
+// allocated on one thread, freed on another, no cell handed out twice
+bool test_cross_thread()
+{
+	const int total = 1000000;
+	const size_t capacity = 4096;
+	auto x = std::make_shared<int>(123);
+	using T = std::shared_ptr<int>;
+	{
+		utttil::concurrent_pool<T> pool(capacity);
+		std::unique_ptr<std::atomic<bool>[]> in_use(new std::atomic<bool>[capacity]);
+		for (size_t i=0 ; i<capacity ; i++)
+			in_use[i] = false;
+		utttil::ring_buffer<T*> handoff(10);
+		std::atomic<bool> success = true;
+
+		std::thread freer([&]()
+			{
+				for (int i=0 ; i<total ; i++)
+				{
+					T * p = handoff.front();
+					handoff.pop_front();
+					if ( ! in_use[pool.index_of(p)].exchange(false))
+						success = false;
+					pool.free(p);
+				}
+			});
+
+		for (int i=0 ; i<total ; )
+		{
+			T * p = pool.alloc(x);
+			if ( ! p)
+				continue; // the freer's magazine has it all
+			if (in_use[pool.index_of(p)].exchange(true))
+				success = false;
+			handoff.push_back(p);
+			i++;
+		}
+		freer.join();
+
+		ASSERT_ACT(success.load(), ==, true, return false);
+		ASSERT_ACT(x.use_count(), ==, 1, return false);
+	}
+	ASSERT_ACT(x.use_count(), ==, 1, return false);
+	return true;
+}
+
+// every thread allocates and frees, some of it crossing threads
+bool test_fuzz()
+{
+	const int thread_count = 4;
+	const int rounds = 200000;
+	const size_t capacity = 4096;
+	utttil::concurrent_pool<size_t> pool(capacity);
+	std::unique_ptr<std::atomic<bool>[]> in_use(new std::atomic<bool>[capacity]);
+	for (size_t i=0 ; i<capacity ; i++)
+		in_use[i] = false;
+	std::atomic<bool> success = true;
+
+	std::vector<std::thread> threads;
+	for (int t=0 ; t<thread_count ; t++)
+		threads.emplace_back([&,t]()
+			{
+				std::vector<size_t*> mine;
+				for (int i=0 ; i<rounds ; i++)
+				{
+					if (mine.size() < 100 && (i+t) % 3 != 0)
+					{
+						size_t * p = pool.alloc(i);
+						if ( ! p)
+							continue;
+						if (in_use[pool.index_of(p)].exchange(true))
+							success = false;
+						mine.push_back(p);
+					}
+					else if ( ! mine.empty())
+					{
+						size_t * p = mine.back();
+						mine.pop_back();
+						if ( ! in_use[pool.index_of(p)].exchange(false))
+							success = false;
+						pool.free(p);
+					}
+				}
+				for (size_t * p : mine)
+				{
+					in_use[pool.index_of(p)] = false;
+					pool.free(p);
+				}
+			});
+	for (auto & t : threads)
+		t.join();
+
+	ASSERT_ACT(success.load(), ==, true, return false);
+	return true;
+}
+
+// an exiting thread gives back its magazine's indices and the magazine itself
+bool test_thread_exit()
+{
+	utttil::concurrent_pool<int, 8> pool(8);
+	for (int t=0 ; t<10 ; t++)
+		std::thread([&]()
+			{
+				std::vector<int*> ptrs;
+				for (int i=0 ; i<8 ; i++)
+					ptrs.push_back(pool.alloc(i));
+				for (int * p : ptrs)
+					pool.free(p);
+			}).join();
+	ASSERT_ACT(pool.magazines.size(), ==, 1ull, return false);
+
+	for (int i=0 ; i<8 ; i++)
+		ASSERT_MSG_ACT(pool.alloc(i), !=, nullptr, std::to_string(i), return false);
+	ASSERT_ACT(pool.magazines.size(), ==, 1ull, return false);
+	return true;
+}
+
+int main()
+{
+	bool success = true
+		&& test_basics()
+		&& test_cross_thread()
+		&& test_fuzz()
+		&& test_thread_exit()
+		;
+
+	return success ? 0 : 1;
+}
@@ -77,6 +77,25 @@ bool test_seqdict_pool_string()
 	return true;
 }
 
+bool test_seqdict_pool_grow()
+{
+	using seqdict_pool = utttil::seqdict_pool<size_t, int>;
+
+	seqdict_pool p(4);
+
+	for (int i=0 ; i<100 ; i++)
+	{
+		auto [seq, inserted] = p.push_back(i);
+		ASSERT_ACT(inserted, ==, true, return false);
+		ASSERT_ACT(seq, ==, typename seqdict_pool::seq_type(i), return false);
+	}
+	ASSERT_ACT(p.size(), ==, size_t(100), return false);
+	for (int i=0 ; i<100 ; i++)
+		ASSERT_ACT(*p.find(i), ==, i, return false);
+
+	return true;
+}
+
 bool test_seqdict_vector()
 {
 	using seqdict_vector = utttil::seqdict_vector<uint64_t, std::string>;
@@ -118,6 +137,7 @@ int main()
 	bool success = true
 		&& test_seqdict_pool()
 		&& test_seqdict_pool_string()
+		&& test_seqdict_pool_grow()
 		&& test_seqdict_vector()
 		;
 
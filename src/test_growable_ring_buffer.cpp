@@ -0,0 +1,136 @@
+#include <thread>
+#include <string>
+
+#include <utttil/growable_ring_buffer.hpp>
+#include <utttil/assert.hpp>
+
+bool test_grow()
+{
+	utttil::growable_ring_buffer<int> rb(2, 5);
+
+	ASSERT_ACT(rb.capacity()    , ==,  4ull, return false);
+	ASSERT_ACT(rb.max_capacity(), ==, 32ull, return false);
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+
+	for (int i=0 ; i<4 ; i++)
+		rb.push_back(i);
+	ASSERT_ACT(rb.capacity(), ==, 4ull, return false);
+	rb.push_back(4);
+	ASSERT_ACT(rb.capacity(), ==, 8ull, return false);
+	for (int i=5 ; i<20 ; i++)
+		rb.push_back(i);
+	ASSERT_ACT(rb.capacity(), ==, 16ull, return false);
+	ASSERT_ACT(rb.size(), ==, 20ull, return false);
+	ASSERT_ACT(rb.high_water_mark(), ==, 20ull, return false);
+
+	for (int i=0 ; i<20 ; i++)
+	{
+		ASSERT_MSG_ACT(rb.front(), ==, i, std::to_string(i), return false);
+		rb.pop_front();
+	}
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+
+	// grows to the max, then wraps in place
+	for (int lap=0 ; lap<10 ; lap++)
+	{
+		for (int i=0 ; i<32 ; i++)
+			rb.push_back(i);
+		for (int i=0 ; i<32 ; i++)
+		{
+			ASSERT_ACT(rb.front(), ==, i, return false);
+			rb.pop_front();
+		}
+	}
+	ASSERT_ACT(rb.capacity(), ==, 32ull, return false);
+	ASSERT_ACT(rb.high_water_mark(), ==, 32ull, return false);
+
+	return true;
+}
+
+// the consumer lags behind a segment switch, elements must not be lost or freed early
+bool test_grow_while_draining()
+{
+	utttil::growable_ring_buffer<std::string> rb(1, 4);
+
+	rb.push_back("a");
+	rb.push_back("b");
+	ASSERT_ACT(rb.front(), ==, std::string("a"), return false);
+	rb.pop_front();
+	rb.push_back("c");
+	rb.push_back("d"); // grows, "b" stays in the old segment
+	ASSERT_ACT(rb.capacity(), ==, 4ull, return false);
+	rb.emplace_back("e");
+	rb.back() = "f";
+	rb.advance_back();
+	ASSERT_ACT(rb.size(), ==, 5ull, return false);
+
+	rb.pop_front(); // skip "b" without looking, past the old segment's end
+	for (const char * s : {"c", "d", "e", "f"})
+	{
+		ASSERT_ACT(rb.front(), ==, std::string(s), return false);
+		rb.pop_front();
+	}
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+	return true;
+}
+
+bool test_thread_safety_fuzz()
+{
+	const int total = 1000000;
+	utttil::growable_ring_buffer<int> rb(2, 12);
+
+	std::thread producer([&]()
+		{
+			for (int i=0 ; i<total ; i++)
+				rb.push_back(i);
+		});
+
+	bool success = true;
+	for (int i=0 ; i<total ; i++)
+	{
+		if (rb.front() != i)
+			success = false;
+		rb.pop_front();
+	}
+	producer.join();
+
+	ASSERT_ACT(success, ==, true, return false);
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+	// older segments still being drained add up to less than the last one
+	ASSERT_ACT(rb.high_water_mark(), <, 2*rb.max_capacity(), return false);
+	return true;
+}
+
+// built in place from forwarded arguments, neither copied nor assigned
+struct only_built
+{
+	std::string s;
+	only_built() = default;
+	only_built(std::string && s_) : s(std::move(s_)) {}
+	only_built(const only_built &) = delete;
+	only_built & operator=(const only_built &) = delete;
+};
+bool test_emplace()
+{
+	utttil::growable_ring_buffer<only_built> rb(1, 3);
+	for (int i=0 ; i<6 ; i++)
+		rb.emplace_back(std::to_string(i));
+	for (int i=0 ; i<6 ; i++)
+	{
+		ASSERT_ACT(rb.front().s, ==, std::to_string(i), return false);
+		rb.pop_front();
+	}
+	return true;
+}
+
+int main()
+{
+	bool success = true
+		&& test_grow()
+		&& test_grow_while_draining()
+		&& test_thread_safety_fuzz()
+		&& test_emplace()
+		;
+
+	return success ? 0 : 1;
+}
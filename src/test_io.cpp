@@ -178,6 +178,44 @@ bool test_srv_2_cli_udpmr(std::string url, std::string url_replay)
 	return true;
 }
 
+// more than a replay client's outbox holds, served over several pack()
+bool test_long_replay(std::string url, std::string url_replay)
+{
+	const size_t missed = 2000;
+	Request sent_by_server;
+	sent_by_server.type = Request::Type::NewOrder;
+	sent_by_server.account_id = 1;
+	sent_by_server.req_id = 1;
+
+	utttil::io::context ctx;
+	ctx.run();
+
+	auto server_sptr = ctx.bind_msg<Request,Request>(url, url_replay);
+	ASSERT_ACT(server_sptr, !=, nullptr, return false);
+	for (size_t i=0 ; i<missed ; i++)
+	{
+		sent_by_server.seq = i;
+		server_sptr->get_outbox_msg()->push_back(sent_by_server);
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	auto client_sptr = ctx.connect_msg<Request,Request>(url, url_replay);
+	ASSERT_ACT(client_sptr, !=, nullptr, return false);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	sent_by_server.seq = missed;
+	server_sptr->get_outbox_msg()->push_back(sent_by_server);
+
+	for (size_t i=0 ; i<=missed ; i++)
+	{
+		while (client_sptr->get_inbox_msg()->empty())
+			_mm_pause();
+		ASSERT_ACT(client_sptr->get_inbox_msg()->front().get_seq().value(), ==, (uint64_t)i, return false);
+		client_sptr->get_inbox_msg()->pop_front();
+	}
+	return true;
+}
+
 bool test_2_ways_msg(std::string url)
 {
 	Request sent_by_client;
@@ -295,6 +333,7 @@ int main()
 		//&& test("ws://127.0.0.1:1234/")
 		&& test_srv_2_cli_udpm("udpm://226.1.1.1:2000/")
 		&& test_srv_2_cli_udpmr("udpmr://226.1.1.1:2004/", "tcp://127.0.0.1:2005")
+		&& test_long_replay("udpmr://226.1.1.1:2006/", "tcp://127.0.0.1:2007")
 		&& test_2_ways    ( "tcp://127.0.0.1:2002/")
 		&& test_2_ways_msg( "tcp://127.0.0.1:2003/")
 		;
@@ -9,17 +9,18 @@
 #include <utttil/assert.hpp>
 
 #include "utttil/iou.hpp"
+#include "utttil/iou/cluster.hpp"
 
 #include "msg.hpp"
 
-bool test(std::string url)
+bool test(std::string url, utttil::iou::context_config config = utttil::iou::context_config())
 {
 	std::string sent_by_client = "32jk1hkjh1k3j4h62kj345h6345kljh345kj7h";
 	std::string sent_by_server = "4322431423412412412341243213";
 	std::string recv_by_client;
 	std::string recv_by_server;
 
-	utttil::iou::context ctx;
+	utttil::iou::context ctx(config);
 	ctx.run();
 	std::cout << "context running" << std::endl;
 
@@ -74,7 +75,7 @@ bool test(std::string url)
 	return true;
 }
 
-bool test_msg(std::string url)
+bool test_msg(std::string url, utttil::iou::context_config config = utttil::iou::context_config())
 {
 	Request sent_by_client;
 	sent_by_client.type = Request::Type::NewOrder;
@@ -111,7 +112,7 @@ bool test_msg(std::string url)
 	Request recv_by_client;
 	Request recv_by_server;
 
-	utttil::iou::context<Request> ctx;
+	utttil::iou::context<Request> ctx(config);
 	ctx.run();
 	
 	std::cout << "context running" << std::endl;
@@ -184,12 +185,273 @@ bool test_msg(std::string url)
 	return true;
 }
 
+// a big zero-copy send between two copied writes, all read back in order
+bool test_zc(std::string url)
+{
+	std::string head = "head";
+	std::string body(1 << 20, 'x');
+	for (size_t i=0 ; i<body.size() ; i++)
+		body[i] = 'a' + i % 26;
+	std::string tail = "tail";
+	std::string expected = head + body + tail;
+
+	utttil::iou::context ctx;
+	ctx.run();
+
+	auto server_sptr = ctx.bind(url);
+	ASSERT_ACT(server_sptr, !=, nullptr, return false);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	auto client_sptr = ctx.connect(url);
+	ASSERT_ACT(client_sptr, !=, nullptr, return false);
+
+	while (server_sptr->accept_inbox.empty())
+		_mm_pause();
+	auto server_client_sptr = server_sptr->accept_inbox.front();
+	server_sptr->accept_inbox.pop_front();
+
+	std::atomic_bool released = false;
+	client_sptr->async_write(head.data(), head.size());
+	client_sptr->async_send_zc(body.data(), body.size(), [&](){ released = true; });
+	client_sptr->async_write(tail.data(), tail.size());
+
+	std::string received;
+	while (received.size() < expected.size())
+	{
+		auto [ptr, size] = server_client_sptr->inbox.front_stretch();
+		received.append(ptr, size);
+		server_client_sptr->inbox.advance_front(size);
+	}
+	while ( ! released)
+		_mm_pause();
+
+	ASSERT_ACT(received.size(), ==, expected.size(), return false);
+	ASSERT_ACT(received == expected, ==, true, return false);
+	return true;
+}
+
+// the other side resets while the kernel holds the memory: completion still runs
+bool test_zc_reset(std::string url, int port)
+{
+	int listener = utttil::iou::server_socket_tcp(port, false);
+	ASSERT_ACT(listener, !=, -1, return false);
+
+	utttil::iou::context ctx;
+	ctx.run();
+	auto client_sptr = ctx.connect(url);
+	ASSERT_ACT(client_sptr, !=, nullptr, return false);
+	int fd = ::accept(listener, nullptr, nullptr);
+	ASSERT_ACT(fd, !=, -1, return false);
+
+	// more than the socket buffers hold while nobody reads
+	std::string body(64 << 20, 'x');
+	std::atomic_bool released = false;
+	client_sptr->async_send_zc(body.data(), body.size(), [&](){ released = true; });
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	linger abort = {1, 0};
+	::setsockopt(fd, SOL_SOCKET, SO_LINGER, &abort, sizeof(abort));
+	::close(fd);
+	::close(listener);
+	for ( auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5)
+		; ! released && std::chrono::steady_clock::now() < deadline
+		; )
+		_mm_pause();
+	ASSERT_ACT((bool)released, ==, true, return false);
+	return true;
+}
+
+// connections land on both rings and each echoes through its own
+bool test_cluster(std::string url, utttil::iou::sharding how)
+{
+	utttil::iou::cluster cl(2);
+	cl.run();
+
+	auto acceptors = cl.bind(url, how);
+	ASSERT_ACT(acceptors.empty(), ==, false, return false);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	const size_t count = 8;
+	std::vector<std::shared_ptr<utttil::iou::peer<>>> clients;
+	for (size_t i=0 ; i<count ; i++)
+	{
+		clients.push_back(cl.connect(url));
+		ASSERT_ACT(clients.back(), !=, nullptr, return false);
+	}
+
+	std::vector<std::shared_ptr<utttil::iou::peer<>>> accepted;
+	while (accepted.size() < count)
+		for (auto & acceptor : acceptors)
+			if ( ! acceptor->accept_inbox.empty())
+			{
+				accepted.push_back(acceptor->accept_inbox.front());
+				acceptor->accept_inbox.pop_front();
+			}
+
+	size_t on_ring[2] = {0, 0};
+	for (auto & p : accepted)
+		for (size_t i=0 ; i<cl.size() ; i++)
+			if (&p->ring == &cl[i].ring)
+				on_ring[i]++;
+	ASSERT_ACT(on_ring[0] + on_ring[1], ==, count, return false);
+	if (how == utttil::iou::sharding::round_robin)
+		ASSERT_ACT(on_ring[0], ==, on_ring[1], return false);
+
+	// each client says its index, the server side sends it back
+	for (size_t i=0 ; i<count ; i++)
+	{
+		char c = 'a' + i;
+		clients[i]->async_write(&c, 1);
+	}
+	for (auto & p : accepted)
+	{
+		while (p->inbox.empty())
+			_mm_pause();
+		char c = *std::get<0>(p->inbox.front_stretch());
+		p->inbox.advance_front(1);
+		p->async_write(&c, 1);
+	}
+	for (size_t i=0 ; i<count ; i++)
+	{
+		while (clients[i]->inbox.empty())
+			_mm_pause();
+		char c = *std::get<0>(clients[i]->inbox.front_stretch());
+		clients[i]->inbox.advance_front(1);
+		ASSERT_ACT(c, ==, (char)('a' + i), return false);
+	}
+
+	std::atomic_bool ran = false;
+	cl.post(1, [&](){ ran = true; });
+	while ( ! ran)
+		_mm_pause();
+	return true;
+}
+
+// a peer reset by the other side is closed, the others keep going
+bool test_reset(std::string url, int port)
+{
+	utttil::iou::context ctx;
+	ctx.run();
+
+	auto server_sptr = ctx.bind(url);
+	ASSERT_ACT(server_sptr, !=, nullptr, return false);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	int fd = utttil::iou::client_socket_tcp("127.0.0.1", port);
+	ASSERT_ACT(fd, !=, -1, return false);
+	while (server_sptr->accept_inbox.empty())
+		_mm_pause();
+	auto reset_sptr = server_sptr->accept_inbox.front();
+	server_sptr->accept_inbox.pop_front();
+	linger abort = {1, 0};
+	::setsockopt(fd, SOL_SOCKET, SO_LINGER, &abort, sizeof(abort));
+	::close(fd);
+	// the table is the io thread's, ask it there
+	size_t reset_id = reset_sptr->id;
+	for (bool forgotten = false ; ! forgotten ; )
+	{
+		std::atomic<int> answer = -1;
+		ctx.post([&](){ answer = ctx.find(reset_id) == nullptr; });
+		while (answer == -1)
+			_mm_pause();
+		forgotten = answer == 1;
+	}
+
+	auto client_sptr = ctx.connect(url);
+	ASSERT_ACT(client_sptr, !=, nullptr, return false);
+	while (server_sptr->accept_inbox.empty())
+		_mm_pause();
+	auto server_client_sptr = server_sptr->accept_inbox.front();
+	server_sptr->accept_inbox.pop_front();
+	char c = 'r';
+	client_sptr->async_write(&c, 1);
+	while (server_client_sptr->inbox.empty())
+		_mm_pause();
+	ASSERT_ACT(*std::get<0>(server_client_sptr->inbox.front_stretch()), ==, 'r', return false);
+	return true;
+}
+
+// an entry reused after a peer is forgotten doesn't answer to its old id
+bool test_peer_table()
+{
+	utttil::iou::context_config config;
+	config.max_peers = 2;
+	utttil::iou::context ctx(config);
+
+	size_t a = ctx.new_id();
+	size_t b = ctx.new_id();
+	ASSERT_ACT(a, !=, 0u, return false);
+	ASSERT_ACT(b, !=, 0u, return false);
+	ASSERT_ACT(ctx.new_id(), ==, 0u, return false);
+
+	ctx.release_id(a);
+	size_t c = ctx.new_id();
+	ASSERT_ACT(c & ctx.entry_mask, ==, a & ctx.entry_mask, return false);
+	ASSERT_ACT(c, !=, a, return false);
+	ASSERT_ACT(ctx.find(a), ==, nullptr, return false);
+	return true;
+}
+
+utttil::iou::context_config multishot(unsigned recv_buffer_size)
+{
+	utttil::iou::context_config config;
+	config.multishot_accept = true;
+	config.multishot_recv = true;
+	config.recv_buffer_count = 8;
+	config.recv_buffer_size = recv_buffer_size;
+	return config;
+}
+
+// peers' sockets and inbox/outbox registered with the ring
+utttil::iou::context_config registered()
+{
+	utttil::iou::context_config config;
+	config.max_registered_peers = 16;
+	config.fixed_files = true;
+	config.fixed_buffers = true;
+	return config;
+}
+utttil::iou::context_config sqpoll()
+{
+	utttil::iou::context_config config;
+	config.sqpoll = true;
+	return config;
+}
+utttil::iou::context_config single_issuer()
+{
+	utttil::iou::context_config config;
+	config.single_issuer = true;
+	return config;
+}
+utttil::iou::context_config defer_taskrun()
+{
+	utttil::iou::context_config config;
+	config.coop_taskrun = true;
+	config.defer_taskrun = true;
+	return config;
+}
+
 int main()
 {
 	bool success = true
 		//&& test("ws://127.0.0.1:1234/")
 		&& test("tcp://127.0.0.1:1234/")
 		&& test_msg("tcp://127.0.0.1:4321/")
+		&& test("tcp://127.0.0.1:1235/", multishot(4096))
+		&& test_msg("tcp://127.0.0.1:4322/", multishot(16)) // messages span buffers
+		&& test("tcp://127.0.0.1:1240/", registered())
+		&& test_msg("tcp://127.0.0.1:4323/", registered())
+		&& test("tcp://127.0.0.1:1241/", sqpoll())
+		&& test_msg("tcp://127.0.0.1:4324/", sqpoll())
+		&& test("tcp://127.0.0.1:1242/", single_issuer())
+		&& test_msg("tcp://127.0.0.1:4325/", single_issuer())
+		&& test("tcp://127.0.0.1:1243/", defer_taskrun())
+		&& test_msg("tcp://127.0.0.1:4326/", defer_taskrun())
+		&& test_zc("tcp://127.0.0.1:1236/")
+		&& test_zc_reset("tcp://127.0.0.1:1244/", 1244)
+		&& test_cluster("tcp://127.0.0.1:1237/", utttil::iou::sharding::reuse_port)
+		&& test_cluster("tcp://127.0.0.1:1238/", utttil::iou::sharding::round_robin)
+		&& test_peer_table()
+		&& test_reset("tcp://127.0.0.1:1239/", 1239)
 		;
 
 	return success?0:1;
@@ -0,0 +1,211 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+
+#include <utttil/mpmc_ring_buffer.hpp>
+#include <utttil/assert.hpp>
+#include <utttil/perf.hpp>
+
+bool test_back()
+{
+	utttil::mpmc_ring_buffer<int> rb(4);
+
+	ASSERT_ACT(rb.capacity(), ==, 16ull, return false);
+	ASSERT_ACT(rb.size()    , ==,  0ull, return false);
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+	ASSERT_ACT(rb.full(), ==, false, return false);
+
+	for (size_t i=0 ; i<rb.capacity() ; i++)
+	{
+		rb.push_back(i);
+		ASSERT_MSG_ACT(rb.front   (), ==,   0, std::to_string(i), return false);
+		ASSERT_MSG_ACT(rb.size    (), ==, i+1ull, std::to_string(i), return false);
+	}
+	ASSERT_ACT(rb.full(), ==, true, return false);
+	ASSERT_ACT(rb.empty(), ==, false, return false);
+
+	for (size_t i=0 ; i<rb.capacity() ; i++)
+	{
+		ASSERT_MSG_ACT(rb.front(), ==, (int)i, std::to_string(i), return false);
+		rb.pop_front();
+	}
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+
+	return true;
+}
+
+bool test_zero_copy()
+{
+	utttil::mpmc_ring_buffer<std::string> rb(2);
+
+	for (int lap=0 ; lap<3 ; lap++)
+	{
+		for (size_t i=0 ; i<rb.capacity() ; i++)
+		{
+			std::string & s = rb.back();
+			ASSERT_ACT(&rb.back(), ==, &s, return false); // same slot until advance_back()
+			s = std::to_string(lap*10+i);
+			rb.advance_back();
+		}
+		ASSERT_ACT(rb.full(), ==, true, return false);
+		for (size_t i=0 ; i<rb.capacity() ; i++)
+		{
+			std::string s;
+			rb.pop_front(s);
+			ASSERT_ACT(s, ==, std::to_string(lap*10+i), return false);
+		}
+		ASSERT_ACT(rb.empty(), ==, true, return false);
+	}
+	return true;
+}
+
+// claims are per call, not per thread: one thread can hold several, on
+// different rings or on the same one
+bool test_claim()
+{
+	utttil::mpmc_ring_buffer<std::string> a(2);
+	utttil::mpmc_ring_buffer<std::string> b(2);
+
+	auto claim_a1 = a.claim_back();
+	auto claim_b  = b.claim_back();
+	auto claim_a2 = a.claim_back();
+	ASSERT_ACT(claim_a1.s != claim_a2.s, ==, true, return false);
+	*claim_a1 = "a1";
+	*claim_a2 = "a2";
+	*claim_b  = "b";
+	ASSERT_ACT(a.empty(), ==, true, return false);
+	a.publish(claim_a1);
+	b.publish(claim_b);
+	ASSERT_ACT(a.size(), ==, 2ull, return false);
+	ASSERT_ACT(a.front(), ==, "a1", return false);
+	a.pop_front();
+	ASSERT_ACT(a.empty(), ==, true, return false); // a2 claimed, not published
+	a.publish(claim_a2);
+	ASSERT_ACT(a.front(), ==, "a2", return false);
+	ASSERT_ACT(b.front(), ==, "b", return false);
+
+	a.emplace_back(3, 'x');
+	a.pop_front();
+	ASSERT_ACT(a.front(), ==, "xxx", return false);
+	return true;
+}
+
+// several producers, one consumer: per-producer order must be preserved
+bool test_fan_in()
+{
+	const int producers = 4;
+	const int per_producer = 100000;
+	utttil::mpmc_ring_buffer<std::pair<int,int>> rb(10);
+
+	utttil::measurement_point mp("mpmc fan-in push_back + pop");
+
+	std::vector<std::thread> threads;
+	for (int p=0 ; p<producers ; p++)
+		threads.emplace_back([&,p]()
+			{
+				for (int i=0 ; i<per_producer ; i++)
+					rb.push_back(std::make_pair(p, i));
+			});
+
+	std::vector<int> next(producers, 0);
+	bool success = true;
+	{
+		utttil::measurement m(mp);
+		for (int i=0 ; i<producers*per_producer ; i++)
+		{
+			auto [p, v] = rb.front();
+			rb.pop_front();
+			if (v != next[p]++)
+				success = false;
+			++mp.run_count;
+		}
+	}
+	for (auto & t : threads)
+		t.join();
+
+	ASSERT_ACT(success, ==, true, return false);
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+	return true;
+}
+
+// several producers, several consumers: every element is seen exactly once
+bool test_mpmc()
+{
+	const int producers = 3;
+	const int consumers = 3;
+	const int per_producer = 100000;
+	utttil::mpmc_ring_buffer<int> rb(10);
+
+	std::atomic<long long> sum = 0;
+	std::vector<std::thread> threads;
+	for (int p=0 ; p<producers ; p++)
+		threads.emplace_back([&]()
+			{
+				for (int i=1 ; i<=per_producer ; i++)
+					rb.push_back(i);
+			});
+	for (int c=0 ; c<consumers ; c++)
+		threads.emplace_back([&]()
+			{
+				long long local = 0;
+				for (int i=0 ; i<producers*per_producer/consumers ; i++)
+				{
+					int v;
+					rb.pop_front(v);
+					local += v;
+				}
+				sum += local;
+			});
+	for (auto & t : threads)
+		t.join();
+
+	long long expected = (long long)producers * per_producer * (per_producer+1) / 2;
+	ASSERT_ACT(sum.load(), ==, expected, return false);
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+	return true;
+}
+
+// a copy that throws happens before a slot is claimed, the ring goes on
+struct throwing_copy
+{
+	int i = 0;
+	throwing_copy() = default;
+	throwing_copy(int i_) : i(i_) {}
+	throwing_copy(const throwing_copy & other) : i(other.i) { if (i < 0) throw std::runtime_error("copy"); }
+	throwing_copy(throwing_copy &&) noexcept = default;
+	throwing_copy & operator=(const throwing_copy & other) { i = other.i; if (i < 0) throw std::runtime_error("copy"); return *this; }
+	throwing_copy & operator=(throwing_copy &&) noexcept = default;
+};
+bool test_throwing_copy()
+{
+	utttil::mpmc_ring_buffer<throwing_copy> rb(2);
+	throwing_copy bad(-1);
+	bool thrown = false;
+	try {
+		rb.push_back(bad);
+	} catch (std::runtime_error &) {
+		thrown = true;
+	}
+	ASSERT_ACT(thrown, ==, true, return false);
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+	rb.push_back(throwing_copy(1));
+	throwing_copy out;
+	rb.pop_front(out);
+	ASSERT_ACT(out.i, ==, 1, return false);
+	return true;
+}
+
+int main()
+{
+	bool success = true
+		&& test_back()
+		&& test_zero_copy()
+		&& test_fan_in()
+		&& test_claim()
+		&& test_mpmc()
+		&& test_throwing_copy()
+		;
+
+	return success ? 0 : 1;
+}
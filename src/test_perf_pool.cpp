@@ -0,0 +1,143 @@
+
+#include <string>
+#include <chrono>
+#include <vector>
+#include <memory>
+
+#include <utttil/perf.hpp>
+#include <utttil/pool.hpp>
+#include <utttil/soa_pool.hpp>
+#include <utttil/srlz.hpp>
+
+struct Order
+{
+	std::uint64_t id;
+	std::uint64_t price;
+	std::uint64_t quantity;
+	std::uint32_t account_id;
+	std::uint32_t instrument_id;
+};
+
+// snapshot and restore of a pool with one cell in 4 free
+bool test_snapshot(size_t capacity)
+{
+	utttil::measurement_point mps(std::string("serialize ").append(std::to_string(capacity)));
+	utttil::measurement_point mpd(std::string("deserialize ").append(std::to_string(capacity)));
+	utttil::measurement_point mpf(std::string("for_each ").append(std::to_string(capacity)));
+
+	utttil::fixed_pool<Order> pool(capacity);
+	std::vector<Order*> ptrs;
+	ptrs.reserve(capacity);
+	for (size_t i=0 ; i<capacity ; i++)
+		ptrs.push_back(pool.alloc(Order{i, i, i, (std::uint32_t)i, (std::uint32_t)i}));
+	for (size_t i=0 ; i<capacity ; i+=4)
+		pool.free(ptrs[i]);
+
+	std::vector<char> buf(capacity * (sizeof(Order) + 8) + 64);
+	utttil::fixed_pool<Order> restored;
+
+	for ( auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1)
+		; std::chrono::steady_clock::now() < deadline
+		; )
+	{
+		size_t size;
+		{
+			utttil::measurement m(mps);
+			auto s = utttil::srlz::to_binary(utttil::srlz::device::ptr_writer(buf.data()));
+			s << pool;
+			size = s.write.size();
+		}
+		{
+			utttil::measurement m(mpd);
+			auto ds = utttil::srlz::from_binary(utttil::srlz::device::ptr_reader(buf.data(), size));
+			ds >> restored;
+		}
+		{
+			utttil::measurement m(mpf);
+			std::uint64_t sum = 0;
+			pool.for_each([&](Order & o){ sum += o.quantity; });
+			if (sum == 0)
+				return false;
+		}
+	}
+	return restored.size() == pool.size();
+}
+
+// random reads over a large pool, where TLB misses dominate
+template<typename Storage>
+bool test_random_access(size_t capacity, const char * name)
+{
+	utttil::measurement_point mpc(std::string("construct ").append(name));
+	utttil::measurement_point mpr(std::string("random access x1000 ").append(name));
+
+	std::unique_ptr<utttil::fixed_pool<Order,std::uint32_t,Storage>> pool;
+	{
+		utttil::measurement m(mpc);
+		pool.reset(new utttil::fixed_pool<Order,std::uint32_t,Storage>(capacity));
+	}
+	while ( ! pool->full())
+		pool->alloc(Order{1, 1, 1, 1, 1});
+
+	std::uint64_t sum = 0;
+	std::uint64_t x = 88172645463325252ull;
+	for ( auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1)
+		; std::chrono::steady_clock::now() < deadline
+		; )
+	{
+		utttil::measurement m(mpr);
+		for (int i=0 ; i<1000 ; i++)
+		{
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			sum += pool->element_at(x % capacity).quantity;
+		}
+	}
+	return sum != 0;
+}
+
+// a sweep reading 2 of the fields, over the whole struct or over 2 columns
+bool test_sweep(size_t capacity)
+{
+	utttil::measurement_point mpa(std::string("sweep 2 fields, fixed_pool ").append(std::to_string(capacity)));
+	utttil::measurement_point mps(std::string("sweep 2 fields, soa_pool ").append(std::to_string(capacity)));
+
+	utttil::fixed_pool<Order,std::uint32_t,utttil::heap_storage,utttil::lifo_reuse,false> aos(capacity);
+	utttil::soa_pool<std::uint64_t, std::uint64_t, std::uint64_t, std::uint32_t, std::uint32_t> soa(capacity);
+	for (size_t i=0 ; i<capacity ; i++)
+	{
+		aos.alloc(Order{i, i, i, (std::uint32_t)i, (std::uint32_t)i});
+		soa.alloc(i, i, i, (std::uint32_t)i, (std::uint32_t)i);
+	}
+
+	std::uint64_t sum_aos = 0;
+	std::uint64_t sum_soa = 0;
+	for ( auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1)
+		; std::chrono::steady_clock::now() < deadline
+		; )
+	{
+		{
+			utttil::measurement m(mpa);
+			aos.for_each([&](Order & o){ sum_aos += o.price * o.quantity; });
+		}
+		{
+			utttil::measurement m(mps);
+			const std::uint64_t * price = soa.column<1>();
+			const std::uint64_t * quantity = soa.column<2>();
+			for (size_t i=0 ; i<soa.capacity() ; i++) // all live
+				sum_soa += price[i] * quantity[i];
+		}
+	}
+	return sum_aos == sum_soa;
+}
+
+int main()
+{
+	bool result = true
+		&& test_snapshot(1000000)
+		&& test_snapshot(10000000)
+		&& test_random_access<utttil::heap_storage>(10000000, "heap_storage")
+		&& test_random_access<utttil::mmap_storage<>>(10000000, "mmap_storage<huge_pages|prefault>")
+		&& test_sweep(1000000)
+		;
+
+	return result ? 0 : 1;
+}
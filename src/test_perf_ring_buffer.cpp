@@ -2,19 +2,22 @@
 #include <typeinfo>
 #include <string>
 #include <chrono>
+#include <thread>
+#include <vector>
 
 #include <utttil/no_init.hpp>
 #include <utttil/perf.hpp>
 
 #include <utttil/ring_buffer.hpp>
 
-template<typename T>
+template<typename T, typename Stats=utttil::no_ring_stats>
 bool test(T default_value)
 {
-	utttil::measurement_point mpf(std::string("pop_front ").append(typeid(T).name()));
-	utttil::measurement_point mpb(std::string("push_back ").append(typeid(T).name()));
+	const char * suffix = Stats::enabled ? " with stats" : "";
+	utttil::measurement_point mpf(std::string("pop_front ").append(typeid(T).name()).append(suffix));
+	utttil::measurement_point mpb(std::string("push_back ").append(typeid(T).name()).append(suffix));
 
-	utttil::ring_buffer<T> rb(10);
+	utttil::ring_buffer<T,utttil::spin_wait,utttil::heap_storage,Stats> rb(10);
 
 	for(size_t i=0 ; i<rb.capacity()/2 ; i++)
 		rb.push_back(default_value);
@@ -35,13 +38,84 @@ bool test(T default_value)
 	return true;
 }
 
+template<typename T>
+bool test_batch(T default_value)
+{
+	const size_t batch_size = 64;
+	utttil::measurement_point mpf(std::string("pop_front_n(64) ").append(typeid(T).name()));
+	utttil::measurement_point mpb(std::string("push_back_n(64) ").append(typeid(T).name()));
+
+	utttil::ring_buffer<T> rb(10);
+	std::vector<T> batch(batch_size, default_value);
+
+	for(size_t i=0 ; i<rb.capacity()/2 ; i++)
+		rb.push_back(default_value);
+
+	for ( auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1)
+		; std::chrono::steady_clock::now() < deadline
+		; )
+	{
+		{
+			utttil::measurement m(mpb);
+			rb.push_back_n(batch.data(), batch_size);
+		}
+		{
+			utttil::measurement m(mpf);
+			rb.pop_front_n(batch.data(), batch_size);
+		}
+	}
+	return true;
+}
+
+// one hop = one push_back on one thread seen by front() on another thread
+template<typename Wait>
+bool test_ping_pong()
+{
+	utttil::measurement_point mp(std::string("ping-pong round trip (2 hops) ").append(typeid(Wait).name()));
+
+	utttil::ring_buffer<size_t,Wait> ping(10);
+	utttil::ring_buffer<size_t,Wait> pong(10);
+
+	std::thread t([&]()
+		{
+			for (;;)
+			{
+				size_t v = ping.front();
+				ping.pop_front();
+				if (v == 0)
+					return;
+				pong.push_back(v);
+			}
+		});
+
+	bool success = true;
+	size_t i = 1;
+	for ( auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1)
+		; std::chrono::steady_clock::now() < deadline
+		; i++)
+	{
+		utttil::measurement m(mp);
+		ping.push_back(i);
+		success &= pong.front() == i;
+		pong.pop_front();
+	}
+	ping.push_back(0);
+	t.join();
+	return success;
+}
+
 int main()
 {
 	bool success = true
 		&& test<char>('a')
 		&& test<utttil::no_init<char>>('b')
 		&& test<int>(12345)
+		&& test<int,utttil::ring_stats>(12345)
 		&& test<std::string>("abcdefghij")
+		&& test_batch<char>('a')
+		&& test_batch<int>(12345)
+		&& test_ping_pong<utttil::spin_wait>()
+		&& test_ping_pong<utttil::park_wait<>>()
 		;
 
 	return success ? 0 : 1;
@@ -0,0 +1,124 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+#include <string>
+
+#include <utttil/io.hpp>
+#include <utttil/perf.hpp>
+
+#include "msg.hpp"
+
+// Round trips between two processes, the child echoes back what it receives.
+
+std::shared_ptr<utttil::io::peer_msg<Request,Request>> wait_accepted(std::shared_ptr<utttil::io::peer_msg<Request,Request>> server_sptr)
+{
+	auto accept_inbox = server_sptr->get_accept_inbox();
+	if ( ! accept_inbox) // shm: the server end is the connection
+		return server_sptr;
+	while (accept_inbox->empty())
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	auto result = accept_inbox->front();
+	accept_inbox->pop_front();
+	return result;
+}
+
+int echo(const utttil::url & url)
+{
+	utttil::io::context ctx;
+	if (url.protocol != "shm") // shm needs no io thread
+		ctx.run();
+	auto server_sptr = ctx.bind_msg<Request,Request>(url);
+	if ( ! server_sptr)
+		return 1;
+	auto peer_sptr = wait_accepted(server_sptr);
+	auto & inbox = *peer_sptr->get_inbox_msg();
+	for (;;)
+	{
+		Request & req = inbox.front();
+		bool end = req.type == Request::Type::End;
+		peer_sptr->async_send(req);
+		inbox.pop_front();
+		if (end)
+			break;
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(100)); // let the io thread flush
+	return 0;
+}
+
+bool test(std::string url_str)
+{
+	utttil::url url(url_str);
+
+	pid_t pid = fork();
+	if (pid == 0)
+		_exit(echo(url));
+
+	utttil::io::context ctx;
+	if (url.protocol != "shm")
+		ctx.run();
+	std::shared_ptr<utttil::io::peer_msg<Request,Request>> client_sptr;
+	for ( auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5)
+		; ! client_sptr && std::chrono::steady_clock::now() < deadline
+		; )
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		client_sptr = ctx.connect_msg<Request,Request>(url);
+	}
+	if ( ! client_sptr)
+	{
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+		return false;
+	}
+	auto & inbox = *client_sptr->get_inbox_msg();
+
+	Request req;
+	req.type = Request::Type::NewOrder;
+	req.seq        = 0;
+	req.account_id = 1;
+	req.req_id     = 1;
+	NewOrder & new_order = req.new_order;
+	new_order.instrument_id = 1;
+	new_order.is_sell                   = false;
+	new_order.is_limit                  = true;
+	new_order.is_stop                   = false;
+	new_order.participate_dont_initiate = false;
+	new_order.time_in_force = TimeInForce::GTD;
+	new_order.lot_count      = 1;
+	new_order.pic_count      = 1;
+	new_order.stop_pic_count = 0;
+	bool success = true;
+	{
+		utttil::measurement_point mp(std::string(url.protocol).append(" round trip between processes (2 hops)"));
+		for ( auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1)
+			; std::chrono::steady_clock::now() < deadline
+			; )
+		{
+			utttil::measurement m(mp);
+			++req.seq;
+			client_sptr->async_send(req);
+			success &= inbox.front().seq == req.seq;
+			inbox.pop_front();
+		}
+	}
+	req.type = Request::Type::End;
+	client_sptr->async_send(req);
+	inbox.front();
+	inbox.pop_front();
+
+	int status;
+	waitpid(pid, &status, 0);
+	return success && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main()
+{
+	bool success = true
+		&& test("shm://utttil_test_perf_shm")
+		&& test("tcp://127.0.0.1:2020")
+		;
+
+	return success ? 0 : 1;
+}
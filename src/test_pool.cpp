@@ -3,9 +3,11 @@
 #include <vector>
 #include <chrono>
 #include <set>
+#include <array>
 #include <string>
 
 #include <utttil/pool.hpp>
+#include <utttil/srlz.hpp>
 #include <utttil/assert.hpp>
 
 bool test_basics()
@@ -263,6 +265,307 @@ bool test_object()
 	return true;
 }
 
+bool test_segmented()
+{
+	utttil::segmented_pool<std::string> pool(3);
+
+	ASSERT_ACT(pool.slab_size(), ==, 4ull, return false);
+	ASSERT_ACT(pool.capacity(), ==, 0ull, return false);
+
+	std::vector<std::string*> ptrs;
+	for (int i=0 ; i<10 ; i++)
+		ptrs.push_back(pool.alloc(std::to_string(i)));
+	ASSERT_ACT(pool.size(), ==, 10ull, return false);
+	ASSERT_ACT(pool.capacity(), ==, 12ull, return false);
+
+	// growing didn't move anything, handles are stable
+	for (int i=0 ; i<10 ; i++)
+	{
+		ASSERT_MSG_ACT(*ptrs[i], ==, std::to_string(i), std::to_string(i), return false);
+		ASSERT_MSG_ACT(pool.handle_of(ptrs[i]), ==, (size_t)i, std::to_string(i), return false);
+		ASSERT_MSG_ACT(&pool.element_at(i), ==, ptrs[i], std::to_string(i), return false);
+	}
+	std::string other;
+	ASSERT_ACT(pool.contains(&other), ==, false, return false);
+
+	// freed cells of any slab are reused before growing again
+	pool.free(ptrs[1]);
+	pool.free(ptrs[6]);
+	std::string * a = pool.alloc("a");
+	std::string * b = pool.alloc("b");
+	ASSERT_ACT(a, ==, ptrs[6], return false);
+	ASSERT_ACT(b, ==, ptrs[1], return false);
+	ASSERT_ACT(pool.capacity(), ==, 12ull, return false);
+
+	size_t for_each_count = 0;
+	pool.for_each([&](std::string &){ for_each_count++; });
+	ASSERT_ACT(for_each_count, ==, 10ull, return false);
+
+	// in handle order, skipping freed cells
+	pool.free(ptrs[3]);
+	ASSERT_ACT(pool.is_constructed(3), ==, false, return false);
+	std::string visited;
+	pool.for_each([&](std::string & s){ visited += s; });
+	ASSERT_ACT(visited, ==, std::string("0b245a789"), return false);
+
+	return true;
+}
+
+bool test_segmented_fuzz()
+{
+	auto x = std::make_shared<int>(123);
+	{
+		using T = decltype(x);
+		utttil::segmented_pool<T> pool(64);
+		std::set<T*> ptrs;
+
+		for (int round=0 ; round<1000 ; round++)
+		{
+			int m = rand() % 200;
+			for (int i=0 ; i<m ; i++)
+			{
+				T * ptr = pool.alloc(x);
+				ASSERT_MSG_ACT(ptrs.find(ptr) == ptrs.end(), ==, true, std::to_string(i), return false);
+				ASSERT_ACT(pool.contains(ptr), ==, true, return false);
+				ptrs.insert(ptr);
+			}
+			int n = ptrs.empty() ? 0 : rand() % ptrs.size();
+			for (int i=0 ; i<n ; i++)
+			{
+				auto it = std::next(ptrs.begin(), ((rand() % ptrs.size())));
+				pool.free(*it);
+				ptrs.erase(it);
+			}
+		}
+		ASSERT_ACT(pool.size(), ==, (size_t)x.use_count()-1, return false);
+	}
+	ASSERT_ACT(0, ==, x.use_count()-1, return false);
+
+	return true;
+}
+
+bool test_for_each()
+{
+	utttil::fixed_pool<int> pool(200);
+
+	std::vector<int*> ptrs;
+	for (int i=0 ; i<200 ; i++)
+		ptrs.push_back(pool.alloc(i));
+	// holes across word boundaries
+	for (int i : {0, 1, 63, 64, 65, 127, 128, 199})
+		pool.free(ptrs[i]);
+
+	std::vector<int> seen;
+	pool.for_each([&](int & v){ seen.push_back(v); });
+	ASSERT_ACT(seen.size(), ==, 192ull, return false);
+	ASSERT_ACT(std::is_sorted(seen.begin(), seen.end()), ==, true, return false);
+	ASSERT_ACT(seen.front(), ==, 2, return false);
+	ASSERT_ACT(seen.back(), ==, 198, return false);
+	ASSERT_ACT(std::find(seen.begin(), seen.end(), 64) == seen.end(), ==, true, return false);
+
+	return true;
+}
+
+bool test_serialize()
+{
+	utttil::fixed_pool<std::string> pool(100);
+	std::vector<std::string*> ptrs;
+	for (int i=0 ; i<100 ; i++)
+		ptrs.push_back(pool.alloc(std::to_string(i)));
+	for (int i=0 ; i<100 ; i+=3)
+		pool.free(ptrs[i]);
+
+	std::vector<char> v;
+	{
+		auto s = utttil::srlz::to_binary(utttil::srlz::device::back_inserter(v));
+		s << pool;
+	}
+
+	utttil::fixed_pool<std::string> restored(8);
+	restored.alloc("overwritten");
+	auto ds = utttil::srlz::from_binary(utttil::srlz::device::iterator_reader(v.begin(), v.end()));
+	ds >> restored;
+
+	ASSERT_ACT(restored.capacity(), ==, 100ull, return false);
+	ASSERT_ACT(restored.size(), ==, pool.size(), return false);
+	ASSERT_ACT(restored == pool, ==, true, return false);
+	restored.element_at(1) = "changed";
+	ASSERT_ACT(restored == pool, ==, false, return false);
+	restored.element_at(1) = "1";
+	for (int i=0 ; i<100 ; i++)
+	{
+		ASSERT_MSG_ACT(restored.is_constructed(i), ==, i%3 != 0, std::to_string(i), return false);
+		if (i%3 != 0)
+			ASSERT_MSG_ACT(restored.element_at(i), ==, std::to_string(i), std::to_string(i), return false);
+	}
+
+	// the free cells are usable, and only them
+	std::set<std::string*> fresh;
+	while ( ! restored.full())
+	{
+		std::string * p = restored.alloc("new");
+		ASSERT_ACT(restored.index_of(p) % 3, ==, 0u, return false);
+		ASSERT_ACT(fresh.insert(p).second, ==, true, return false);
+	}
+	ASSERT_ACT(fresh.size(), ==, 34ull, return false);
+
+	return true;
+}
+
+template<typename Storage>
+bool test_storage()
+{
+	utttil::fixed_pool<std::string,std::uint32_t,Storage> pool(100000);
+
+	std::vector<std::string*> ptrs;
+	while ( ! pool.full())
+		ptrs.push_back(pool.alloc(std::to_string(ptrs.size())));
+	for (size_t i=0 ; i<ptrs.size() ; i+=2)
+		pool.free(ptrs[i]);
+	size_t count = 0;
+	pool.for_each([&](std::string & s){ count += s == std::to_string(pool.index_of(s)); });
+	ASSERT_ACT(count, ==, 50000ull, return false);
+
+	return true;
+}
+
+bool test_static()
+{
+	static_assert(std::is_same<utttil::static_pool<int,200    >::index_t, std::uint8_t >::value);
+	static_assert(std::is_same<utttil::static_pool<int,255    >::index_t, std::uint8_t >::value);
+	static_assert(std::is_same<utttil::static_pool<int,256    >::index_t, std::uint16_t>::value);
+	static_assert(std::is_same<utttil::static_pool<int,100000 >::index_t, std::uint32_t>::value);
+
+	// an intrusive list with 2-byte links
+	struct node
+	{
+		int value;
+		utttil::handle<node,std::uint16_t> next;
+	};
+	static_assert(sizeof(node) == 8);
+	using pool_t = utttil::static_pool<node,1000>;
+	std::unique_ptr<pool_t> pool(new pool_t);
+	ASSERT_ACT(pool->capacity(), ==, 1000ull, return false);
+
+	pool_t::handle_t head;
+	ASSERT_ACT((bool)head, ==, false, return false);
+	while ( ! pool->full())
+	{
+		pool_t::handle_t h = pool->alloc_handle(node{(int)pool->size(), head});
+		ASSERT_ACT((bool)h, ==, true, return false);
+		head = h;
+	}
+	ASSERT_ACT(pool->alloc_handle(node{}).is_null(), ==, true, return false);
+	ASSERT_ACT(pool->alloc(), ==, nullptr, return false);
+
+	int expected = 999;
+	for (pool_t::handle_t h = head ; h ; h = (*pool)[h].next)
+		ASSERT_ACT((*pool)[h].value, ==, expected--, return false);
+	ASSERT_ACT(expected, ==, -1, return false);
+
+	// unlink and free every other node
+	for (pool_t::handle_t h = head ; h && (*pool)[h].next ; h = (*pool)[h].next)
+	{
+		pool_t::handle_t victim = (*pool)[h].next;
+		(*pool)[h].next = (*pool)[victim].next;
+		pool->free_handle(victim);
+	}
+	ASSERT_ACT(pool->size(), ==, 500ull, return false);
+	size_t count = 0;
+	pool->for_each([&](node & n){ count += n.value % 2; });
+	ASSERT_ACT(count, ==, 500ull, return false);
+
+	node * n = pool->alloc(node{-1, head});
+	ASSERT_ACT(n, !=, nullptr, return false);
+	ASSERT_ACT(pool->contains(n), ==, true, return false);
+	ASSERT_ACT(&(*pool)[pool->handle_of(n)], ==, n, return false);
+	pool->free(n);
+	ASSERT_ACT(pool->size(), ==, 500ull, return false);
+
+	return true;
+}
+
+bool test_reuse()
+{
+	utttil::fixed_pool<int,std::uint32_t,utttil::heap_storage,utttil::lifo_reuse> lifo(8);
+	utttil::fixed_pool<int,std::uint32_t,utttil::heap_storage,utttil::fifo_reuse> fifo(8);
+
+	int * l[4];
+	int * f[4];
+	for (int i=0 ; i<4 ; i++)
+	{
+		l[i] = lifo.alloc(i);
+		f[i] = fifo.alloc(i);
+	}
+	lifo.free(l[1]);
+	fifo.free(f[1]);
+
+	// the freed cell comes back first, or last
+	ASSERT_ACT(lifo.index_of(lifo.alloc()), ==, 1u, return false);
+	for (unsigned i=4 ; i<8 ; i++)
+		ASSERT_MSG_ACT(fifo.index_of(fifo.alloc()), ==, i, std::to_string(i), return false);
+	ASSERT_ACT(fifo.index_of(fifo.alloc()), ==, 1u, return false);
+	ASSERT_ACT(fifo.full(), ==, true, return false);
+
+	// from full, the free list starts over
+	fifo.free(f[2]);
+	fifo.free(f[0]);
+	ASSERT_ACT(fifo.index_of(fifo.alloc()), ==, 2u, return false);
+	ASSERT_ACT(fifo.index_of(fifo.alloc()), ==, 0u, return false);
+
+	return true;
+}
+
+bool test_poison()
+{
+	using T = std::array<std::uint64_t,4>;
+	utttil::fixed_pool<T,std::uint32_t,utttil::heap_storage,utttil::lifo_reuse,true> pool(4);
+
+	T * a = pool.alloc();
+	T * b = pool.alloc();
+	(*a)[2] = 123;
+	(*b)[2] = 789;
+	pool.free(a);
+	const volatile unsigned char * freed = (const unsigned char *) &(*a)[2];
+#ifdef UTTTIL_ASAN
+	ASSERT_ACT(__asan_address_is_poisoned((const void*)freed), ==, 1, return false);
+	ASSERT_ACT(__asan_address_is_poisoned(&(*b)[2]), ==, 0, return false);
+#else
+	ASSERT_ACT(*freed, ==, utttil::pool_poison_byte, return false);
+#endif
+
+	// reused cells are usable again
+	T * c = pool.alloc();
+	ASSERT_ACT(c, ==, a, return false);
+	(*c)[2] = 456;
+	ASSERT_ACT((*c)[2], ==, 456ull, return false);
+	ASSERT_ACT((*b)[2], ==, 789ull, return false);
+
+	return true;
+}
+
+bool test_stats()
+{
+	utttil::fixed_pool<int> pool(4);
+
+	int * p[4];
+	for (int i=0 ; i<4 ; i++)
+		p[i] = pool.alloc(i);
+	ASSERT_ACT(pool.alloc(), ==, nullptr, return false);
+	pool.free(p[0]);
+	pool.free(p[1]);
+	pool.alloc();
+
+	utttil::pool_stats s = pool.stats();
+	ASSERT_ACT(s.live, ==, 3ull, return false);
+	ASSERT_ACT(s.peak, ==, 4ull, return false);
+	ASSERT_ACT(s.allocs, ==, 5ull, return false);
+	ASSERT_ACT(s.frees, ==, 2ull, return false);
+	ASSERT_ACT(s.failed_allocs, ==, 1ull, return false);
+
+	return true;
+}
+
 int main()
 {
 	auto seed = time(NULL); // 1646605269;
@@ -277,6 +580,17 @@ int main()
 		&& test_index_of()
 		&& test_fuzz()
 		&& test_object()
+		&& test_for_each()
+		&& test_serialize()
+		&& test_static()
+		&& test_reuse()
+		&& test_poison()
+		&& test_stats()
+		&& test_storage<utttil::mmap_storage<>>()
+		&& test_storage<utttil::mmap_storage<0>>()
+		&& test_storage<utttil::mmap_storage<utttil::prefault,0>>()
+		&& test_segmented()
+		&& test_segmented_fuzz()
 		;
 
 	if (success)
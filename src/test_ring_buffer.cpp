@@ -1,6 +1,7 @@
 
 #include <atomic>
 #include <thread>
+#include <sstream>
 
 #include <utttil/ring_buffer.hpp>
 #include <utttil/assert.hpp>
@@ -149,6 +150,198 @@ bool test_stretches()
 	return true;
 }
 
+bool test_mirrored()
+{
+	utttil::mirrored_ring_buffer<char> rb(12);
+	const size_t cap = rb.capacity();
+
+	// the second mapping shows the same bytes
+	rb.data[0] = 'x';
+	ASSERT_ACT(rb.data[cap], ==, 'x', return false);
+	rb.data[cap+1] = 'y';
+	ASSERT_ACT(rb.data[1], ==, 'y', return false);
+
+	// straddle the end of the buffer
+	rb.advance_back(cap - 10);
+	rb.advance_front(cap - 10);
+	auto [back_ptr, back_size] = rb.back_stretch();
+	ASSERT_ACT(back_ptr, ==, &rb.data[cap-10], return false);
+	ASSERT_ACT(back_size, ==, cap, return false);
+	ASSERT_ACT(std::get<1>(rb.back_stretch_2()), ==, 0ull, return false);
+	for (int i=0 ; i<20 ; i++)
+		back_ptr[i] = 'a' + i;
+	rb.advance_back(20);
+
+	auto [front_ptr, front_size] = rb.front_stretch();
+	ASSERT_ACT(front_ptr, ==, &rb.data[cap-10], return false);
+	ASSERT_ACT(front_size, ==, 20ull, return false);
+	ASSERT_ACT(std::get<1>(rb.front_stretch_2()), ==, 0ull, return false);
+	ASSERT_ACT(std::string(front_ptr, front_size), ==, std::string("abcdefghijklmnopqrst"), return false);
+	ASSERT_ACT(rb.data[0], ==, 'k', return false);
+
+	// batches don't need to split either
+	char out[20];
+	rb.pop_front_n(out, 20);
+	ASSERT_ACT(std::string(out, 20), ==, std::string("abcdefghijklmnopqrst"), return false);
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+
+	return true;
+}
+
+bool test_mmap_storage()
+{
+	utttil::ring_buffer<std::string,utttil::spin_wait,utttil::mmap_storage<>> rb(10);
+
+	for (int round=0 ; round<3 ; round++)
+	{
+		for (size_t i=0 ; i<rb.capacity() ; i++)
+			rb.push_back(std::to_string(i));
+		for (size_t i=0 ; i<rb.capacity() ; i++)
+		{
+			ASSERT_MSG_ACT(rb.front(), ==, std::to_string(i), std::to_string(i), return false);
+			rb.pop_front();
+		}
+	}
+	return true;
+}
+
+bool test_batch()
+{
+	utttil::ring_buffer<int> rb(4);
+	int in[70];
+	int out[5];
+	for (int i=0 ; i<70 ; i++)
+		in[i] = i;
+
+	// wrap around a few times with odd-sized batches
+	int next_out = 0;
+	for (int lap=0 ; lap<10 ; lap++)
+	{
+		rb.push_back_n(&in[lap*7], 7);
+		ASSERT_ACT(rb.size(), ==, 7ull, return false);
+		rb.pop_front_n(out, 5);
+		for (int i=0 ; i<5 ; i++)
+			ASSERT_MSG_ACT(out[i], ==, next_out++, std::to_string(lap), return false);
+		bool ordered = true;
+		size_t visited = rb.consume_available([&](int & v) { ordered &= v == next_out++; });
+		ASSERT_ACT(ordered, ==, true, return false);
+		ASSERT_ACT(visited, ==, 2ull, return false);
+		ASSERT_ACT(rb.empty(), ==, true, return false);
+	}
+
+	// a full capacity batch in one go
+	rb.push_back_n(in, rb.capacity());
+	ASSERT_ACT(rb.full(), ==, true, return false);
+	ASSERT_ACT(rb.consume_available([](int &){}), ==, rb.capacity(), return false);
+	ASSERT_ACT(rb.consume_available([](int &){}), ==, 0ull, return false);
+
+	return true;
+}
+
+bool test_try()
+{
+	utttil::ring_buffer<int> rb(2);
+
+	int v = -1;
+	ASSERT_ACT(rb.try_front(), ==, nullptr, return false);
+	ASSERT_ACT(rb.try_pop(v), ==, false, return false);
+	ASSERT_ACT(rb.try_push(1), ==, true, return false);
+	const int two = 2;
+	ASSERT_ACT(rb.try_push(two), ==, true, return false);
+	ASSERT_ACT(rb.try_emplace(3), ==, true, return false);
+	ASSERT_ACT(rb.try_emplace(4), ==, true, return false);
+	ASSERT_ACT(rb.try_push(5), ==, false, return false);
+	ASSERT_ACT(rb.try_emplace(5), ==, false, return false);
+	ASSERT_ACT(rb.size(), ==, 4ull, return false);
+
+	ASSERT_ACT(*rb.try_front(), ==, 1, return false);
+	for (int i=1 ; i<=4 ; i++)
+	{
+		ASSERT_ACT(rb.try_pop(v), ==, true, return false);
+		ASSERT_ACT(v, ==, i, return false);
+	}
+	ASSERT_ACT(rb.try_pop(v), ==, false, return false);
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+	return true;
+}
+
+struct counted
+{
+	static inline int constructed = 0;
+	static inline int assigned = 0;
+	int a, b;
+	counted() noexcept : a(0), b(0) {}
+	counted(int a_, int b_) noexcept : a(a_), b(b_) { ++constructed; }
+	counted & operator=(const counted & other) noexcept { a = other.a; b = other.b; ++assigned; return *this; }
+};
+
+bool test_emplace_in_place()
+{
+	utttil::ring_buffer<counted> rb(2);
+
+	rb.emplace_back(1, 2);
+	rb.try_emplace(3, 4);
+	ASSERT_ACT(counted::constructed, ==, 2, return false);
+	ASSERT_ACT(counted::assigned   , ==, 0, return false);
+	ASSERT_ACT(rb.front().a, ==, 1, return false);
+	ASSERT_ACT(rb.front().b, ==, 2, return false);
+	rb.pop_front();
+	ASSERT_ACT(rb.front().a, ==, 3, return false);
+
+	// may throw: built aside then assigned, so a failure leaves the slot intact
+	utttil::ring_buffer<std::string> rbs(2);
+	rbs.emplace_back(3, 'x');
+	ASSERT_ACT(rbs.front(), ==, std::string("xxx"), return false);
+	return true;
+}
+
+bool test_stats()
+{
+	// every push sampled
+	using rb_t = utttil::ring_buffer<int, utttil::spin_wait, utttil::heap_storage, utttil::basic_ring_stats<1>>;
+	rb_t rb(4);
+
+	for (int i=0 ; i<5 ; i++)
+		rb.push_back(i);
+	rb.pop_front();
+	rb.pop_front();
+	int batch[3] = {5, 6, 7};
+	rb.push_back_n(batch, 3);
+
+	utttil::ring_stats_snapshot s = rb.stats();
+	ASSERT_ACT(s.pushes, ==, 8ull, return false);
+	ASSERT_ACT(s.pops  , ==, 2ull, return false);
+	ASSERT_ACT(s.high_water_mark, ==, 6ull, return false);
+	ASSERT_ACT(s.full_spins , ==, 0ull, return false);
+	ASSERT_ACT(s.empty_spins, ==, 0ull, return false);
+	// sizes after each push: 1, 2, 3, 4, 5, then 6 for the batch
+	ASSERT_ACT(s.occupancy_log2[1], ==, 1ull, return false);
+	ASSERT_ACT(s.occupancy_log2[2], ==, 2ull, return false);
+	ASSERT_ACT(s.occupancy_log2[3], ==, 3ull, return false);
+	ASSERT_ACT(s.occupancy_log2[4], ==, 0ull, return false);
+
+	std::ostringstream oss;
+	oss << rb;
+	ASSERT_ACT(oss.str().find("high_water_mark: 6"), !=, std::string::npos, return false);
+	ASSERT_ACT(oss.str().find("occupancy_log2: {1: 1, 2: 2, 3: 3}"), !=, std::string::npos, return false);
+
+	// one push in sample_period
+	utttil::ring_buffer<int, utttil::spin_wait, utttil::heap_storage, utttil::ring_stats> sampled(8);
+	for (size_t i=0 ; i<2*utttil::ring_stats::sample_period ; i++)
+		sampled.push_back(i);
+	s = sampled.stats();
+	size_t samples = 0;
+	for (size_t count : s.occupancy_log2)
+		samples += count;
+	ASSERT_ACT(samples, ==, 2ull, return false);
+	ASSERT_ACT(s.high_water_mark, ==, 2*utttil::ring_stats::sample_period, return false);
+
+	// without stats the ring doesn't grow
+	static_assert(sizeof(utttil::ring_buffer<int>) == 3 * utttil::ring_buffer<int>::cache_line_size);
+
+	return true;
+}
+
 bool test_thread_safety_fuzz()
 {
 	std::atomic_bool go_on = true;
@@ -187,13 +380,55 @@ bool test_thread_safety_fuzz()
 	return true;
 }
 
+// same as above but idle sides park instead of spinning, so it doesn't need a core per thread
+bool test_thread_safety_fuzz_park()
+{
+	const int total = 1000000;
+	utttil::ring_buffer<int, utttil::park_wait<>> rb(5);
+
+	utttil::measurement_point mp("push_back + pop, park_wait");
+	utttil::measurement m(mp);
+
+	std::thread twrite([&]()
+		{
+			for (int i=0 ; i<total ; i++)
+				rb.push_back(i);
+		});
+	bool ordered = true;
+	std::thread tread([&]()
+		{
+			for (int i=0 ; i<total; i++)
+			{
+				ordered &= rb.front() == i;
+				rb.pop_front();
+				++mp.run_count;
+			}
+		});
+
+	twrite.join();
+	tread.join();
+
+	ASSERT_ACT(ordered, ==, true, return false);
+	ASSERT_ACT(mp.run_count, ==, (size_t)total, return false);
+	ASSERT_ACT(rb.empty(), ==, true, return false);
+
+	return true;
+}
+
 int main()
 {
 	bool success = true
 		&& test_back()
 		&& test_object()
 		&& test_stretches()
+		&& test_mirrored()
+		&& test_mmap_storage()
+		&& test_batch()
+		&& test_try()
+		&& test_emplace_in_place()
+		&& test_stats()
 		&& test_thread_safety_fuzz()
+		&& test_thread_safety_fuzz_park()
 		;
 
 	return success ? 0 : 1;
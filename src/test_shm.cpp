@@ -0,0 +1,67 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <utttil/io/shm_msg.hpp>
+#include <utttil/assert.hpp>
+
+using segment = utttil::io::shm_segment<int,int>;
+
+bool test_one_server_one_client()
+{
+	utttil::url url("shm://utttil_test_shm");
+	segment server(url);
+	ASSERT_ACT(server.create(4, 4), ==, true, return false);
+	segment other_server(url);
+	ASSERT_ACT(other_server.create(4, 4), ==, false, return false);
+
+	segment client(url);
+	ASSERT_ACT(client.attach(), ==, true, return false);
+	ASSERT_ACT(client.good(), ==, true, return false);
+	segment other_client(url);
+	ASSERT_ACT(other_client.attach(), ==, false, return false);
+
+	// the rings work wherever each end mapped them
+	ASSERT_ACT((void*)client.hdr, !=, (void*)server.hdr, return false);
+	client.c2s()->push_back(42);
+	ASSERT_ACT(server.c2s()->front(), ==, 42, return false);
+	server.c2s()->pop_front();
+
+	client.close();
+	ASSERT_ACT(other_client.attach(), ==, true, return false);
+
+	server.close();
+	ASSERT_ACT(other_client.good(), ==, false, return false);
+	return true;
+}
+
+// a server that died leaves its segment behind for the next one
+bool test_stale()
+{
+	utttil::url url("shm://utttil_test_shm_stale");
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		segment server(url);
+		if (server.create(4, 4))
+			server.owner = false; // don't clean up, as if killed
+		_exit(0);
+	}
+	waitpid(pid, nullptr, 0);
+
+	segment client(url);
+	ASSERT_ACT(client.attach(), ==, false, return false);
+	segment server(url);
+	ASSERT_ACT(server.create(4, 4), ==, true, return false);
+	ASSERT_ACT(client.attach(), ==, true, return false);
+	return true;
+}
+
+int main()
+{
+	bool success = true
+		&& test_one_server_one_client()
+		&& test_stale()
+		;
+
+	return success ? 0 : 1;
+}
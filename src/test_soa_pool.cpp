@@ -0,0 +1,184 @@
+#include <string>
+#include <set>
+#include <memory>
+#include <limits>
+#include <stdexcept>
+
+#include <utttil/soa_pool.hpp>
+#include <utttil/assert.hpp>
+
+bool test_basics()
+{
+	utttil::soa_pool<int, double, std::string> pool(100);
+
+	ASSERT_ACT(pool.capacity(), ==, 100ull, return false);
+	ASSERT_ACT(pool.empty(), ==, true, return false);
+
+	auto a = pool.alloc(1, 1.5, std::string("a"));
+	auto b = pool.alloc();
+	ASSERT_ACT(a, ==, 0u, return false);
+	ASSERT_ACT(b, ==, 1u, return false);
+	ASSERT_ACT(pool.get<0>(a), ==, 1, return false);
+	ASSERT_ACT(pool.get<1>(a), ==, 1.5, return false);
+	ASSERT_ACT(pool.get<2>(a), ==, "a", return false);
+	ASSERT_ACT(pool.get<0>(b), ==, 0, return false);
+	ASSERT_ACT(pool.get<2>(b), ==, "", return false);
+
+	// columns are dense arrays with the same slot index
+	ASSERT_ACT(&pool.column<1>()[a], ==, &pool.get<1>(a), return false);
+	ASSERT_ACT(&pool.column<1>()[b], ==, &pool.column<1>()[a] + 1, return false);
+
+	pool.free(a);
+	ASSERT_ACT(pool.is_live(a), ==, false, return false);
+	ASSERT_ACT(pool.is_live(b), ==, true, return false);
+	ASSERT_ACT(pool.alloc(2, 2.5, std::string("c")), ==, a, return false);
+
+	while ( ! pool.full())
+		pool.alloc();
+	ASSERT_ACT(pool.alloc(), ==, pool.no_index, return false);
+
+	return true;
+}
+
+bool test_scan()
+{
+	utttil::soa_pool<std::int64_t, std::int64_t, char> pool(1000);
+
+	for (int i=0 ; i<1000 ; i++)
+		pool.alloc(i, 2*i, 'x');
+	for (int i=0 ; i<1000 ; i+=2)
+		pool.free(i);
+
+	std::int64_t sum = 0;
+	pool.for_each_index([&](auto idx){ sum += pool.get<0>(idx) * pool.get<1>(idx); });
+
+	// same thing as a dense loop masked with the bitmap
+	const std::int64_t * x = pool.column<0>();
+	const std::int64_t * y = pool.column<1>();
+	std::int64_t dense = 0;
+	for (size_t i=0 ; i<pool.capacity() ; i++)
+		dense += pool.is_live(i) ? x[i] * y[i] : 0;
+
+	std::int64_t expected = 0;
+	for (std::int64_t i=1 ; i<1000 ; i+=2)
+		expected += 2*i*i;
+	ASSERT_ACT(sum, ==, expected, return false);
+	ASSERT_ACT(dense, ==, expected, return false);
+
+	return true;
+}
+
+bool test_fuzz()
+{
+	auto x = std::make_shared<int>(123);
+	{
+		utttil::soa_pool<std::shared_ptr<int>, int> pool(1024);
+		std::set<std::uint32_t> live;
+
+		for (int round=0 ; round<1000 ; round++)
+		{
+			int m = rand() % 100;
+			for (int i=0 ; i<m && ! pool.full() ; i++)
+			{
+				auto idx = pool.alloc(x, i);
+				ASSERT_ACT(live.insert(idx).second, ==, true, return false);
+			}
+			int n = live.empty() ? 0 : rand() % live.size();
+			for (int i=0 ; i<n ; i++)
+			{
+				auto it = std::next(live.begin(), rand() % live.size());
+				pool.free(*it);
+				live.erase(it);
+			}
+			ASSERT_ACT(pool.size(), ==, live.size(), return false);
+		}
+		ASSERT_ACT(pool.size(), ==, (size_t)x.use_count()-1, return false);
+	}
+	ASSERT_ACT(x.use_count(), ==, 1, return false);
+
+	return true;
+}
+
+// gives out a few columns, then fails
+struct failing_storage
+{
+	inline static int allowed = 0;
+	inline static int live = 0;
+	static void * allocate_bytes(size_t bytes)
+	{
+		if (allowed-- == 0)
+			throw std::bad_alloc();
+		++live;
+		return ::malloc(bytes);
+	}
+	static void deallocate_bytes(void * p, size_t)
+	{
+		--live;
+		::free(p);
+	}
+};
+bool test_column_allocation_failure()
+{
+	failing_storage::allowed = 2;
+	bool thrown = false;
+	try {
+		utttil::basic_soa_pool<failing_storage, int, double, char> pool(10);
+	} catch (std::bad_alloc &) {
+		thrown = true;
+	}
+	ASSERT_ACT(thrown, ==, true, return false);
+	ASSERT_ACT(failing_storage::live, ==, 0, return false);
+	return true;
+}
+
+// a field that throws leaves the slot free and the fields before it destroyed
+struct counted
+{
+	inline static int live = 0;
+	counted(int i) { if (i < 0) throw std::runtime_error("field"); ++live; }
+	counted(const counted &) { ++live; }
+	~counted() { --live; }
+};
+bool test_field_construction_failure()
+{
+	{
+		utttil::soa_pool<counted, counted> pool(4);
+		auto a = pool.alloc(1, 2);
+		bool thrown = false;
+		try {
+			pool.alloc(3, -1);
+		} catch (std::runtime_error &) {
+			thrown = true;
+		}
+		ASSERT_ACT(thrown, ==, true, return false);
+		ASSERT_ACT(pool.size(), ==, 1ull, return false);
+		ASSERT_ACT(counted::live, ==, 2, return false);
+		auto b = pool.alloc(5, 6);
+		ASSERT_ACT(b, !=, a, return false);
+		ASSERT_ACT(pool.is_live(b), ==, true, return false);
+		ASSERT_ACT(counted::live, ==, 4, return false);
+	}
+	ASSERT_ACT(counted::live, ==, 0, return false);
+
+	bool thrown = false;
+	try {
+		utttil::soa_pool<int> pool(std::numeric_limits<std::uint32_t>::max());
+	} catch (std::invalid_argument &) {
+		thrown = true;
+	}
+	ASSERT_ACT(thrown, ==, true, return false);
+	return true;
+}
+
+int main()
+{
+	bool success = true
+		&& test_basics()
+		&& test_scan()
+		&& test_fuzz()
+		&& test_column_allocation_failure()
+		&& test_field_construction_failure()
+		;
+
+	return success ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace utttil {
+
+// Bump allocator for transient memory, e.g. what one message or one batch
+// needs while it's being formatted. Nothing is freed on its own: reset()
+// makes everything available again at once. Chunks are kept across resets,
+// except for the ones made for oversized allocations, so that a steady
+// state doesn't malloc at all.
+// Not thread safe, one arena per thread.
+struct arena
+{
+	struct chunk
+	{
+		char * data;
+		size_t size;
+	};
+
+	size_t chunk_size;
+	std::vector<chunk> chunks;
+	size_t current; // chunk ptr points into
+	char * ptr;
+	char * end;
+	size_t allocated_;
+
+	arena(size_t chunk_size_ = 64*1024)
+		: chunk_size(chunk_size_)
+		, current(0)
+		, ptr(nullptr)
+		, end(nullptr)
+		, allocated_(0)
+	{}
+	arena(const arena &) = delete;
+	~arena()
+	{
+		release();
+	}
+
+	// bytes handed out since the last reset()
+	size_t allocated() const { return allocated_; }
+	size_t capacity() const
+	{
+		size_t result = 0;
+		for (const chunk & c : chunks)
+			result += c.size;
+		return result;
+	}
+
+	void * allocate(size_t bytes, size_t align = alignof(std::max_align_t))
+	{
+		size_t pad = (align - (std::uintptr_t)ptr % align) % align;
+		if (size_t(end - ptr) < pad + bytes)
+		{
+			next_chunk(bytes + align);
+			pad = (align - (std::uintptr_t)ptr % align) % align;
+		}
+		char * result = ptr + pad;
+		ptr = result + bytes;
+		allocated_ += bytes;
+		return result;
+	}
+	// nothing calls ~T(), meant for trivially destructible T or T allocating from the arena too
+	template<typename T, typename...Args>
+	T * make(Args&&...args)
+	{
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	void reset()
+	{
+		size_t kept = 0;
+		for (const chunk & c : chunks)
+			if (c.size == chunk_size)
+				chunks[kept++] = c;
+			else
+				::free(c.data);
+		chunks.resize(kept);
+		current = 0;
+		ptr = chunks.empty() ? nullptr : chunks[0].data;
+		end = chunks.empty() ? nullptr : chunks[0].data + chunks[0].size;
+		allocated_ = 0;
+	}
+	// gives all the memory back
+	void release()
+	{
+		for (const chunk & c : chunks)
+			::free(c.data);
+		chunks.clear();
+		current = 0;
+		ptr = end = nullptr;
+		allocated_ = 0;
+	}
+
+	void next_chunk(size_t min_size)
+	{
+		size_t next = ptr == nullptr ? 0 : current + 1;
+		if (next >= chunks.size() || chunks[next].size < min_size)
+		{
+			size_t size = min_size <= chunk_size ? chunk_size : min_size;
+			char * data = (char*) ::malloc(size);
+			if ( ! data)
+				throw std::bad_alloc();
+			chunks.insert(chunks.begin() + next, chunk{data, size});
+		}
+		current = next;
+		ptr = chunks[current].data;
+		end = ptr + chunks[current].size;
+	}
+};
+
+// So that std::pmr containers allocate from an arena. Deallocation is a
+// no-op, the memory comes back with arena::reset().
+struct arena_resource : std::pmr::memory_resource
+{
+	utttil::arena & a;
+
+	arena_resource(utttil::arena & a_)
+		: a(a_)
+	{}
+
+	void * do_allocate(size_t bytes, size_t align) override
+	{
+		return a.allocate(bytes, align);
+	}
+	void do_deallocate(void *, size_t, size_t) override
+	{}
+	bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override
+	{
+		return this == &other;
+	}
+};
+
+} // namespace
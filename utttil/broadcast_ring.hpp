@@ -0,0 +1,216 @@
+#pragma once
+
+#include <cassert>
+#include <cstring>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <type_traits>
+
+namespace utttil {
+
+// Single-writer multiple-reader ring. The writer never waits: it overwrites
+// the oldest element once the ring is full. Each reader owns a cursor and
+// finds out it was lapped through broadcast_ring_overrun, which carries the
+// range of positions it lost, after which it resumes at the oldest element
+// still available.
+// Positions are global and only grow: [begin(), end()) is what's available.
+//
+// Each slot carries a version: 2*pos+1 while the element at pos is being
+// written, 2*pos+2 once it's published. reader::try_pop_front() copies under
+// that version like a seqlock, which is safe from any thread for trivially
+// copyable T. reader::front() hands out a reference into the ring and is
+// for readers that can't race the writer, e.g. living on the writer's thread.
+struct broadcast_ring_overrun : std::exception
+{
+	size_t lost_begin;
+	size_t lost_end;
+
+	broadcast_ring_overrun(size_t b, size_t e)
+		: lost_begin(b)
+		, lost_end(e)
+	{}
+	const char * what() const noexcept override { return "broadcast_ring reader overrun"; }
+};
+
+template<typename T>
+struct broadcast_ring
+{
+	using value_type = T;
+	inline static constexpr size_t cache_line_size = 64;
+
+	struct slot
+	{
+		std::atomic<size_t> version;
+		T value;
+	};
+
+	size_t Capacity;
+	size_t Mask;
+	slot * data;
+
+	// writer
+	alignas(cache_line_size) std::atomic<size_t> back_;
+
+	broadcast_ring(int size_in_bits)
+		: Capacity(1 << size_in_bits)
+		, Mask(Capacity - 1)
+		, data(new slot[Capacity])
+		, back_(0)
+	{
+		for (size_t i=0 ; i<Capacity ; i++)
+			data[i].version.store(0, std::memory_order_relaxed);
+	}
+	broadcast_ring(const broadcast_ring &) = delete;
+	~broadcast_ring()
+	{
+		delete[] data;
+	}
+
+	size_t capacity() const
+	{
+		return Capacity;
+	}
+	size_t end() const
+	{
+		return back_.load(std::memory_order_acquire);
+	}
+	size_t begin() const
+	{
+		size_t e = end();
+		return e > Capacity ? e - Capacity : 0;
+	}
+	size_t size() const
+	{
+		return std::min(end(), Capacity);
+	}
+	bool empty() const
+	{
+		return end() == 0;
+	}
+
+	// writer side
+	T & back()
+	{
+		size_t b = back_.load(std::memory_order_relaxed);
+		slot & s = data[b & Mask];
+		s.version.store(2*b+1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release); // readers see the odd version before any new byte
+		return s.value;
+	}
+	void advance_back()
+	{
+		size_t b = back_.load(std::memory_order_relaxed);
+		data[b & Mask].version.store(2*b+2, std::memory_order_release);
+		back_.store(b+1, std::memory_order_release);
+	}
+	T & push_back(const T & t)
+	{
+		T & result = back();
+		result = t;
+		advance_back();
+		return result;
+	}
+	T & push_back(T && t)
+	{
+		T & result = back();
+		result = std::forward<T>(t);
+		advance_back();
+		return result;
+	}
+	template<typename ...P>
+	T & emplace_back(P... params)
+	{
+		T & result = back();
+		result = T(params...);
+		advance_back();
+		return result;
+	}
+	// random access for the writer's thread, pos in [begin(), end())
+	T & at(size_t pos)
+	{
+		assert(begin() <= pos && pos < end());
+		return data[pos & Mask].value;
+	}
+
+	struct reader
+	{
+		broadcast_ring * rb;
+		size_t pos;
+
+		bool empty() const
+		{
+			return pos == rb->end();
+		}
+		// how far behind the writer this reader is, can exceed capacity() once lapped
+		size_t size() const
+		{
+			return rb->end() - pos;
+		}
+
+		// skips what was lost and reports it
+		[[noreturn]] void overrun()
+		{
+			size_t lost_begin = pos;
+			pos = std::max(pos+1, rb->begin());
+			throw broadcast_ring_overrun(lost_begin, pos);
+		}
+		void check()
+		{
+			if (size() > rb->Capacity)
+				overrun();
+		}
+
+		// zero-copy, for readers that don't race the writer. Not empty() is a precondition.
+		T & front()
+		{
+			assert( ! empty());
+			check();
+			return rb->data[pos & rb->Mask].value;
+		}
+		void pop_front()
+		{
+			++pos;
+		}
+
+		// copies the next element into out, safe from any thread.
+		// Returns false when there's nothing new.
+		bool try_pop_front(T & out)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "try_pop_front() needs trivially copyable elements");
+
+			if (pos == rb->back_.load(std::memory_order_acquire))
+				return false;
+			check();
+			slot & s = rb->data[pos & rb->Mask];
+			size_t version = s.version.load(std::memory_order_acquire);
+			if (version != 2*pos+2)
+				overrun();
+			std::memcpy((void*)&out, (const void*)&s.value, sizeof(T));
+			std::atomic_thread_fence(std::memory_order_acquire); // the copy happens before the re-check
+			if (s.version.load(std::memory_order_relaxed) != version)
+				overrun();
+			++pos;
+			return true;
+		}
+	};
+
+	// a reader that sees what is pushed from now on
+	reader make_reader()
+	{
+		return reader{this, end()};
+	}
+	// a reader starting at pos, typically begin() to replay everything still available
+	reader make_reader(size_t pos)
+	{
+		return reader{this, pos};
+	}
+};
+
+template<typename Out, typename T>
+Out & operator<<(Out & out, const utttil::broadcast_ring<T> & rb)
+{
+	return out << "broadcast_ring sizeof(T): " << sizeof(T) << ", capacity: " << rb.capacity() << ", begin: " << rb.begin() << ", end: " << rb.end();
+}
+
+} // namespace
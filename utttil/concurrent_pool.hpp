@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include <utttil/spinlock.hpp>
+
+namespace utttil {
+
+// Fixed capacity pool that any thread may alloc() from and free() to,
+// whichever thread allocated.
+// Each thread keeps a magazine of free indices and only goes to the shared
+// free list when its magazine is empty (takes half a magazine) or full
+// (gives half back), so the common case touches thread-local state only.
+// The shared free list is a Treiber stack whose head carries a tag next to
+// the index, bumped on every change, so that a stale head can't win a CAS
+// (ABA).
+// Indices sitting in other threads' magazines can't be allocated, so size
+// the pool with threads * magazine_size of slack. A thread that exits gives
+// its magazine's indices back, and the magazine to the next new thread.
+template<typename T, size_t MagazineSize=64>
+struct concurrent_pool
+{
+	using index_t = std::uint32_t;
+	inline static constexpr index_t no_index = std::numeric_limits<index_t>::max();
+
+	struct magazine
+	{
+		size_t count = 0;
+		bool in_use = true; // false once its thread exited, under magazines_lock
+		index_t indices[MagazineSize];
+	};
+
+	// pools alive, for threads exiting to find theirs
+	struct registry
+	{
+		utttil::spinlock lock;
+		std::vector<concurrent_pool*> pools;
+	};
+	static registry & live_pools()
+	{
+		static registry r;
+		return r;
+	}
+
+	// a thread's magazines, one per pool it used, the last one cached
+	struct local_magazines
+	{
+		std::vector<std::pair<std::uint64_t,magazine*>> list;
+		std::pair<std::uint64_t,magazine*> last = {0, nullptr};
+
+		~local_magazines()
+		{
+			registry & r = live_pools();
+			std::lock_guard<utttil::spinlock> lock(r.lock); // keeps the pools alive
+			for (auto & l : list)
+				for (concurrent_pool * pool : r.pools)
+					if (pool->id == l.first)
+						pool->retire(*l.second);
+		}
+	};
+
+	T * collection;
+	std::unique_ptr<std::atomic<index_t>[]> next; // links of the shared free list
+	index_t capacity_;
+	std::uint64_t id; // tells thread-local magazines of dead pools from ours
+
+	alignas(64) std::atomic<std::uint64_t> head; // tag << 32 | index
+
+	alignas(64) utttil::spinlock magazines_lock;
+	std::vector<std::unique_ptr<magazine>> magazines;
+
+	static std::uint64_t make_head(std::uint64_t tag, index_t idx) { return (tag << 32) | idx; }
+	static index_t head_index(std::uint64_t h) { return (index_t) h; }
+	static std::uint64_t head_tag(std::uint64_t h) { return h >> 32; }
+
+	concurrent_pool(size_t capacity)
+		: collection((T*)malloc(sizeof(T) * capacity))
+		, next(new std::atomic<index_t>[capacity])
+		, capacity_(capacity)
+		, id(next_id())
+		, head(make_head(0, capacity == 0 ? no_index : 0))
+	{
+		if ( ! collection)
+			throw std::bad_alloc();
+		if (no_index <= capacity)
+			throw std::invalid_argument("pool dynamic size too big for static index type");
+		for (index_t i=0 ; i<capacity_ ; ++i)
+			next[i].store(i+1 == capacity_ ? no_index : i+1, std::memory_order_relaxed);
+		registry & r = live_pools();
+		std::lock_guard<utttil::spinlock> lock(r.lock);
+		r.pools.push_back(this);
+	}
+	concurrent_pool(const concurrent_pool &) = delete;
+	// no other thread may use the pool anymore
+	~concurrent_pool()
+	{
+		{
+			registry & r = live_pools();
+			std::lock_guard<utttil::spinlock> lock(r.lock);
+			r.pools.erase(std::find(r.pools.begin(), r.pools.end(), this));
+		}
+		std::vector<bool> constructed(capacity_, true);
+		for (index_t i=head_index(head.load()) ; i!=no_index ; i=next[i].load())
+			constructed[i] = false;
+		for (auto & m : magazines)
+			for (size_t i=0 ; i<m->count ; i++)
+				constructed[m->indices[i]] = false;
+		for (index_t i=0 ; i<capacity_ ; i++)
+			if (constructed[i])
+				collection[i].~T();
+		::free(collection);
+	}
+
+	static std::uint64_t next_id()
+	{
+		static std::atomic<std::uint64_t> ids = 0;
+		return ++ids;
+	}
+
+	size_t capacity() const { return capacity_; }
+
+	magazine & local_magazine()
+	{
+		thread_local local_magazines locals;
+		if (locals.last.first == id)
+			return *locals.last.second;
+		for (auto & l : locals.list)
+			if (l.first == id)
+			{
+				locals.last = l;
+				return *l.second;
+			}
+		magazine * m = nullptr;
+		{
+			std::lock_guard<utttil::spinlock> lock(magazines_lock);
+			for (auto & retired : magazines)
+				if ( ! retired->in_use)
+				{
+					m = retired.get();
+					m->in_use = true;
+					break;
+				}
+			if ( ! m)
+			{
+				magazines.push_back(std::make_unique<magazine>());
+				m = magazines.back().get();
+			}
+		}
+		locals.list.emplace_back(id, m);
+		locals.last = locals.list.back();
+		return *m;
+	}
+	// m's thread is exiting
+	void retire(magazine & m)
+	{
+		if (m.count > 0)
+			flush(m, m.count);
+		std::lock_guard<utttil::spinlock> lock(magazines_lock);
+		m.in_use = false;
+	}
+
+	// pops up to n indices off the shared list into m
+	void refill(magazine & m, size_t n)
+	{
+		std::uint64_t h = head.load(std::memory_order_acquire);
+		for (;;)
+		{
+			index_t first = head_index(h);
+			if (first == no_index)
+				return;
+			// walk n links. If another thread changes the list meanwhile, what we
+			// read may be garbage, but then the tag changed and the CAS fails.
+			size_t count = 0;
+			index_t i = first;
+			while (count < n && i != no_index && i < capacity_)
+			{
+				m.indices[m.count + count++] = i;
+				i = next[i].load(std::memory_order_relaxed);
+			}
+			if (i != no_index && i >= capacity_) // garbage
+			{
+				h = head.load(std::memory_order_acquire);
+				continue;
+			}
+			if (head.compare_exchange_weak(h, make_head(head_tag(h)+1, i), std::memory_order_acquire, std::memory_order_acquire))
+			{
+				m.count += count;
+				return;
+			}
+		}
+	}
+	// pushes the n last indices of m onto the shared list, with one CAS
+	void flush(magazine & m, size_t n)
+	{
+		index_t * chain = &m.indices[m.count - n];
+		for (size_t i=0 ; i+1<n ; i++)
+			next[chain[i]].store(chain[i+1], std::memory_order_relaxed);
+		std::uint64_t h = head.load(std::memory_order_relaxed);
+		do {
+			next[chain[n-1]].store(head_index(h), std::memory_order_relaxed);
+		} while ( ! head.compare_exchange_weak(h, make_head(head_tag(h)+1, chain[0]), std::memory_order_release, std::memory_order_relaxed));
+		m.count -= n;
+	}
+
+	template<typename...Args>
+	T * alloc(Args...args)
+	{
+		magazine & m = local_magazine();
+		if (m.count == 0)
+		{
+			refill(m, MagazineSize/2);
+			if (m.count == 0)
+				return nullptr;
+		}
+		T * result = &collection[m.indices[--m.count]];
+		new (result) T(args...);
+		return result;
+	}
+
+	void free(T * ptr)
+	{
+		assert(contains(ptr));
+		ptr->~T();
+		magazine & m = local_magazine();
+		if (m.count == MagazineSize)
+			flush(m, MagazineSize/2);
+		m.indices[m.count++] = index_of(ptr);
+	}
+
+	bool contains(const T * ptr) const
+	{
+		return ptr >= &collection[0] && ptr < &collection[capacity_];
+	}
+	index_t index_of(const T * ptr) const { return ptr - &collection[0]; }
+	index_t index_of(const T & t  ) const { return &t  - &collection[0]; }
+	const T & element_at(index_t idx) const { return collection[idx]; }
+	      T & element_at(index_t idx)       { return collection[idx]; }
+};
+
+} // namespace
@@ -7,7 +7,7 @@
 #include <assert.h>
 #include <algorithm>
 #include <type_traits>
-#include <sstream>
+#include <memory_resource>
 
 #include "utttil/int128.hpp"
 #include "utttil/math.hpp"
@@ -134,12 +134,7 @@ struct dfloat
 		exponent = 0;
 		return *this;
 	}
-	dfloat & operator=(const dfloat & other)
-	{
-		mantissa = other.mantissa;
-		exponent = other.exponent;
-		return *this;
-	}
+	dfloat & operator=(const dfloat & other) = default;
 	template<typename Tag2>
 	dfloat & operator=(dfloat<M,Bits,Tag2> & other)
 	{
@@ -311,11 +306,51 @@ struct dfloat
 		mantissa = (r.template next<mantissa_t>()) % max_mantissa;
 		exponent = (r.template next<exponent_t>()) % max_exponent;
 	}
+	// writes the decimal representation at first, at most max_chars, returns its end
+	inline static constexpr size_t max_chars = 8*sizeof(M) + (size_t(1) << std::min<size_t>(Bits, 10)) + 3;
+	char * to_chars(char * first) const
+	{
+		static_assert(Bits <= 10, "to_chars() has room for up to 1023 decimal places");
+		char * c = first;
+		int decimal_digits = exponent;
+		auto x = mantissa;
+		bool negative = x<0;
+		if (negative)
+			x = -x;
+		while(decimal_digits)
+		{
+			auto r = x%10;
+			if (r != 0)
+				break;
+			x /= 10;
+			decimal_digits--;
+		}
+		while(decimal_digits-->0)
+		{
+			*c++ = '0'+x%10;
+			x /= 10;
+		}
+		if (c != first)
+			*c++ = '.';
+		do
+		{
+			*c++ = '0'+x%10;
+			x /= 10;
+		} while(x>0);
+		if (negative)
+			*c++ = '-';
+		std::reverse(first, c);
+		return c;
+	}
 	std::string to_string() const
 	{
-		std::stringstream ss;
-		ss << *this;
-		return ss.str();
+		char buf[max_chars];
+		return std::string(buf, to_chars(buf));
+	}
+	std::pmr::string to_string(std::pmr::memory_resource * memory) const
+	{
+		char buf[max_chars];
+		return std::pmr::string(buf, to_chars(buf), memory);
 	}
 };
 
@@ -395,39 +430,8 @@ bool operator<=(const utttil::dfloat<M1,B1,Tag1> & left, const utttil::dfloat<M2
 template<typename M, size_t B,typename Tag>
 std::ostream & operator<<(std::ostream & out, const utttil::dfloat<M,B,Tag> & dfp)
 {
-	std::string buf;
-	buf.reserve(60);
-	
-	int decimal_digits = dfp.exponent;
-	auto x = dfp.mantissa;
-	bool negative = x<0;
-	if (negative)
-		x = -x;
-	while(decimal_digits)
-	{
-		auto r = x%10;
-		if (r != 0)
-			break;
-		x /= 10;
-		decimal_digits--;
-	}
-	while(decimal_digits-->0)
-	{
-		buf.append(1, '0'+x%10);
-		x /= 10;
-	}
-	if (buf.size() > 0)
-		buf.append(1, '.');
-	do
-	{
-		buf.append(1, '0'+x%10);
-		x /= 10;
-	} while(x>0);
-	if (negative)
-		buf.append(1, '-');
-	std::reverse(buf.begin(), buf.end());
-	//buf.append("(E-").append(std::to_string((int)dfp.exponent)).append(")");
-	return out << buf;
+	char buf[utttil::dfloat<M,B,Tag>::max_chars];
+	return out.write(buf, dfp.to_chars(buf) - buf);
 }
 
 template<typename M1, size_t B1, typename Tag1, typename M2, size_t B2, typename Tag2>
@@ -4,6 +4,8 @@
 #include <thread>
 #include <vector>
 #include <memory>
+#include <map>
+#include <deque>
 
 #include <boost/container/flat_map.hpp>
 
@@ -13,11 +15,14 @@
 
 namespace utttil {
 
-template<typename K, typename V>
-struct Dict : public std::map<K,V>
+// Alloc can be a std::pmr::polymorphic_allocator, e.g. on a utttil::arena
+// for a dict that lives as long as a batch.
+template<typename K, typename V, typename Alloc=std::allocator<std::pair<const K,V>>>
+struct Dict : public std::map<K,V,std::less<K>,Alloc>
 {
 	using SelfType = Dict;
-	using Super = std::map<K,V>;
+	using Super = std::map<K,V,std::less<K>,Alloc>;
+	using Super::Super;
 
 	V & get(const K & k)
 	{
@@ -37,12 +42,13 @@ struct Dict : public std::map<K,V>
 	}
 };
 
-template<typename K, typename V>
-struct DequeDict : public std::deque<V>
+template<typename K, typename V, typename Alloc=std::allocator<V>>
+struct DequeDict : public std::deque<V,Alloc>
 {
 	using SelfType = DequeDict;
-	using Super = std::deque<V>;
+	using Super = std::deque<V,Alloc>;
 	using value_type = V;
+	using Super::Super;
 
 	V & get(const K & k)
 	{
@@ -73,12 +79,13 @@ struct seqdict_pool
 	using   seq_type = K;
 	using value_type = V;
 	using inserted_t = bool;
-	using pool_idx_t = uint32_t;
+	using pool_idx_t = typename utttil::segmented_pool<V>::handle_t;
 
 	seq_type next_seq = 0;
-	utttil::fixed_pool<V> pool;
+	utttil::segmented_pool<V> pool;
 	absl::flat_hash_map<seq_type,pool_idx_t> key_map;
 
+	// grows by slabs of size
 	seqdict_pool(uint32_t size)
 		: pool(size)
 	{}
@@ -90,11 +97,8 @@ struct seqdict_pool
 	template<typename...Args>
 	std::tuple<seq_type,inserted_t> push_back(Args...args)
 	{
-		value_type * inserted_v = pool.alloc(args...);
-		if ( ! inserted_v)
-			return {0,false};
+		pool_idx_t pool_index = pool.alloc_handle(args...);
 		seq_type inserted_seq = next_seq++;
-		pool_idx_t pool_index = pool.index_of(inserted_v);
 		key_map.insert({inserted_seq, pool_index});
 		return {inserted_seq, true};
 	}
@@ -115,9 +119,8 @@ struct seqdict_pool
 		auto it = key_map.find(k);
 		if (it == key_map.end())
 			return false;
-		V & v = pool.element_at(it->second);
+		pool.free_handle(it->second);
 		key_map.erase(it);
-		pool.free(&v);
 		return true;
 	}
 };
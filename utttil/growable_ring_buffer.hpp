@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cassert>
+#include <immintrin.h>
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <utility>
+
+#include <utttil/wait_policy.hpp>
+
+namespace utttil {
+
+// Single-producer single-consumer ring that doubles its capacity instead of
+// blocking when it fills up, up to 1 << max_size_in_bits.
+// Indices are global and only grow. Storage is a chain of segments: when the
+// producer outgrows its segment it allocates one twice as big, seals the old
+// one at the current back_ and links the new one. The consumer drains the old
+// segment up to the seal, then switches over and frees it. Neither side ever
+// touches a segment the other one has left. While older segments drain,
+// size() can exceed capacity(), but stays under 2 * max_capacity().
+// high_water_mark() is the largest size the producer has seen, so that fixed
+// rings can be sized from what production actually needs.
+// Standalone for now: the io peers expose their rings as ring_buffer<T>.
+template<typename T, typename Wait=spin_wait>
+struct growable_ring_buffer
+{
+	using value_type = T;
+	inline static constexpr size_t cache_line_size = 64;
+	inline static constexpr size_t unsealed = size_t(-1);
+
+	struct segment
+	{
+		size_t Capacity;
+		size_t Mask;
+		T * data;
+		size_t first; // global index of the first element stored here
+		std::atomic<size_t> last; // global index the producer moved on at, unsealed until then
+		segment * next;
+
+		segment(size_t capacity, size_t first_)
+			: Capacity(capacity)
+			, Mask(capacity - 1)
+			, data(new T[capacity])
+			, first(first_)
+			, last(unsealed)
+			, next(nullptr)
+		{}
+		~segment()
+		{
+			delete[] data;
+		}
+		T & operator[](size_t i) { return data[i & Mask]; }
+	};
+
+	size_t MaxCapacity;
+
+	// consumer
+	alignas(cache_line_size) std::atomic<size_t> front_;
+	mutable size_t cached_back_;
+	segment * head_;
+	mutable typename Wait::state front_waiters_; // producer waiting for front_ to move
+
+	// producer
+	alignas(cache_line_size) std::atomic<size_t> back_;
+	mutable size_t cached_front_;
+	segment * tail_;
+	std::atomic<size_t> high_water_;
+	mutable typename Wait::state back_waiters_; // consumer waiting for back_ to move
+
+	growable_ring_buffer(int size_in_bits, int max_size_in_bits)
+		: MaxCapacity(size_t(1) << std::max(size_in_bits, max_size_in_bits))
+		, front_(0)
+		, cached_back_(0)
+		, head_(new segment(size_t(1) << size_in_bits, 0))
+		, back_(0)
+		, cached_front_(0)
+		, tail_(head_)
+		, high_water_(0)
+	{}
+	growable_ring_buffer(const growable_ring_buffer &) = delete;
+	~growable_ring_buffer()
+	{
+		while (head_ != nullptr)
+		{
+			segment * next = head_->next;
+			delete head_;
+			head_ = next;
+		}
+	}
+
+	// producer side, the consumer may still be draining smaller segments
+	size_t capacity() const
+	{
+		return tail_->Capacity;
+	}
+	size_t max_capacity() const
+	{
+		return MaxCapacity;
+	}
+	size_t size() const
+	{
+		size_t f = front_.load(std::memory_order_acquire);
+		return back_.load(std::memory_order_acquire) - f;
+	}
+	bool empty() const
+	{
+		return size() == 0;
+	}
+	size_t high_water_mark() const
+	{
+		return high_water_.load(std::memory_order_relaxed);
+	}
+
+	// consumer side
+	bool empty_cached() const
+	{
+		size_t f = front_.load(std::memory_order_relaxed);
+		if (f < cached_back_)
+			return false;
+		cached_back_ = back_.load(std::memory_order_acquire);
+		return f >= cached_back_;
+	}
+	void wait_not_empty() const
+	{
+		if (empty_cached())
+			Wait::wait(back_, back_waiters_, [this](){ return empty_cached(); });
+	}
+	// moves head_ past sealed segments that are fully drained
+	segment & head_at(size_t f)
+	{
+		while (head_->last.load(std::memory_order_acquire) <= f)
+		{
+			segment * old = head_;
+			head_ = old->next;
+			delete old;
+		}
+		return *head_;
+	}
+	void publish_front(size_t f)
+	{
+		front_.store(f, std::memory_order_release);
+		Wait::notify(front_, front_waiters_);
+	}
+
+	T & front()
+	{
+		wait_not_empty();
+		size_t f = front_.load(std::memory_order_relaxed);
+		return head_at(f)[f];
+	}
+	void pop_front()
+	{
+		wait_not_empty();
+		publish_front(front_.load(std::memory_order_relaxed) + 1);
+	}
+
+	// producer side
+	// makes room for one more element, growing if allowed, waiting otherwise
+	void make_room()
+	{
+		size_t b = back_.load(std::memory_order_relaxed);
+		// slots below tail_->first live in older segments
+		if (b - std::max(cached_front_, tail_->first) < tail_->Capacity)
+			return;
+		cached_front_ = front_.load(std::memory_order_acquire);
+		if (b - std::max(cached_front_, tail_->first) < tail_->Capacity)
+			return;
+		if (tail_->Capacity < MaxCapacity)
+		{
+			segment * s = new segment(tail_->Capacity * 2, b);
+			tail_->next = s;
+			tail_->last.store(b, std::memory_order_release); // publishes next
+			tail_ = s;
+			return;
+		}
+		Wait::wait(front_, front_waiters_, [this,b]()
+			{
+				cached_front_ = front_.load(std::memory_order_acquire);
+				return b - std::max(cached_front_, tail_->first) >= tail_->Capacity;
+			});
+	}
+	void publish_back(size_t b)
+	{
+		back_.store(b, std::memory_order_release);
+		Wait::notify(back_, back_waiters_);
+		// cached_front_ only lags, so this can only overestimate; refresh before recording
+		if (b - cached_front_ > high_water_.load(std::memory_order_relaxed))
+		{
+			cached_front_ = front_.load(std::memory_order_acquire);
+			if (b - cached_front_ > high_water_.load(std::memory_order_relaxed))
+				high_water_.store(b - cached_front_, std::memory_order_relaxed);
+		}
+	}
+
+	T & back()
+	{
+		make_room();
+		T & r = (*tail_)[back_.load(std::memory_order_relaxed)];
+		_m_prefetchw(&r);
+		return r;
+	}
+	void advance_back()
+	{
+		publish_back(back_.load(std::memory_order_relaxed) + 1);
+	}
+
+	T & push_back(T && t)
+	{
+		make_room();
+		size_t b = back_.load(std::memory_order_relaxed);
+		T & result = (*tail_)[b];
+		result = std::forward<T>(t);
+		publish_back(b+1);
+		return result;
+	}
+	T & push_back(const T & t)
+	{
+		make_room();
+		size_t b = back_.load(std::memory_order_relaxed);
+		T & result = (*tail_)[b];
+		result = t;
+		publish_back(b+1);
+		return result;
+	}
+	// slots always hold a T, a throwing constructor leaves a default one
+	template<typename ...P>
+	T & emplace_back(P&&... params)
+	{
+		make_room();
+		size_t b = back_.load(std::memory_order_relaxed);
+		T & result = (*tail_)[b];
+		result.~T();
+		try {
+			new (&result) T(std::forward<P>(params)...);
+		} catch (...) {
+			new (&result) T();
+			throw;
+		}
+		publish_back(b+1);
+		return result;
+	}
+};
+
+template<typename Out, typename T, typename Wait>
+Out & operator<<(Out & out, const utttil::growable_ring_buffer<T,Wait> & rb)
+{
+	return out << "growable_ring_buffer sizeof(T): " << sizeof(T) << ", capacity: " << rb.capacity() << ", max_capacity: " << rb.max_capacity() << ", high_water_mark: " << rb.high_water_mark() << ", front_: " << rb.front_.load() << ", back: " << rb.back_.load();
+}
+
+} // namespace
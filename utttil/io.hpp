@@ -22,6 +22,7 @@
 #include <utttil/io/udpm_raw.hpp>
 #include <utttil/io/udpm_msg.hpp>
 #include <utttil/io/udpmr_msg.hpp>
+#include <utttil/io/shm_msg.hpp>
 
 namespace utttil {
 namespace io {
@@ -141,6 +142,13 @@ struct context
 			peer_sptr = std::make_shared<tcp_server_msg<MsgIn,MsgOut,DataT>>(url);
 		else if (url.protocol == "udpm")
 			peer_sptr = std::make_shared<udpm_server_msg<MsgIn,MsgOut,DataT>>(url);
+		else if (url.protocol == "shm")
+		{
+			if constexpr (shm_compatible<MsgIn,MsgOut>)
+				peer_sptr = std::make_shared<shm_server_msg<MsgIn,MsgOut,DataT>>(url);
+			else
+				std::cout << "shm:// needs trivially copyable messages" << std::endl;
+		}
 		if ( ! peer_sptr || ! peer_sptr->good())
 		{
 			std::cout << "bind failed: " << strerror(errno) << std::endl;
@@ -210,6 +218,13 @@ struct context
 			peer_sptr = std::make_shared<tcp_socket_msg<MsgIn,MsgOut,DataT>>(url);
 		else if (url.protocol == "udpm")
 			peer_sptr = std::make_shared<udpm_client_msg<MsgIn,MsgOut,DataT>>(url);
+		else if (url.protocol == "shm")
+		{
+			if constexpr (shm_compatible<MsgIn,MsgOut>)
+				peer_sptr = std::make_shared<shm_client_msg<MsgIn,MsgOut,DataT>>(url);
+			else
+				std::cout << "shm:// needs trivially copyable messages" << std::endl;
+		}
 		if ( ! peer_sptr || ! peer_sptr->good())
 		{
 			std::cout << "connect failed to " << url.to_string() << std::endl;
@@ -225,11 +240,8 @@ struct context
 		std::vector<std::shared_ptr<peer>> accept_peers;
 		while(go_on)
 		{
-			while ( ! new_accept_peers.empty())
-			{
-				accept_peers.push_back(new_accept_peers.front());
-				new_accept_peers.pop_front();
-			}
+			for (std::shared_ptr<peer> p ; new_accept_peers.try_pop(p) ; )
+				accept_peers.push_back(std::move(p));
 			for(int i=accept_peers.size()-1 ; i>=0 ; i--)
 			{
 				std::shared_ptr<peer> peer_sptr = accept_peers[i];
@@ -253,11 +265,8 @@ struct context
 		std::vector<std::shared_ptr<peer>> read_peers;
 		while(go_on)
 		{
-			while ( ! new_read_peers.empty())
-			{
-				read_peers.push_back(new_read_peers.front());
-				new_read_peers.pop_front();
-			}
+			for (std::shared_ptr<peer> p ; new_read_peers.try_pop(p) ; )
+				read_peers.push_back(std::move(p));
 			for(int i=read_peers.size()-1 ; i>=0 ; i--)
 			{
 				auto peer_sptr = read_peers[i];
@@ -285,11 +294,8 @@ struct context
 		std::vector<std::shared_ptr<peer>> write_peers;
 		while(go_on)
 		{
-			while ( ! new_write_peers.empty())
-			{
-				write_peers.push_back(new_write_peers.front());
-				new_write_peers.pop_front();
-			}
+			for (std::shared_ptr<peer> p ; new_write_peers.try_pop(p) ; )
+				write_peers.push_back(std::move(p));
 			for(int i=write_peers.size()-1 ; i>=0 ; i--)
 			{
 				std::shared_ptr<peer> peer_sptr = write_peers[i];
@@ -315,11 +321,8 @@ struct context
 		std::vector<std::shared_ptr<peer>> write_peers;
 		while(go_on)
 		{
-			while ( ! new_accept_peers.empty())
-			{
-				accept_peers.push_back(new_accept_peers.front());
-				new_accept_peers.pop_front();
-			}
+			for (std::shared_ptr<peer> p ; new_accept_peers.try_pop(p) ; )
+				accept_peers.push_back(std::move(p));
 			for(int i=accept_peers.size() ; i>0 ; )
 			{
 				--i;
@@ -336,11 +339,8 @@ struct context
 				add(new_peer_sptr);
 			}
 			
-			while ( ! new_write_peers.empty())
-			{
-				write_peers.push_back(new_write_peers.front());
-				new_write_peers.pop_front();
-			}
+			for (std::shared_ptr<peer> p ; new_write_peers.try_pop(p) ; )
+				write_peers.push_back(std::move(p));
 			for(int i=write_peers.size() ; i>0 ; )
 			{
 				--i;
@@ -358,11 +358,8 @@ struct context
 				}
 			}
 
-			while ( ! new_read_peers.empty())
-			{
-				read_peers.push_back(new_read_peers.front());
-				new_read_peers.pop_front();
-			}
+			for (std::shared_ptr<peer> p ; new_read_peers.try_pop(p) ; )
+				read_peers.push_back(std::move(p));
 			for(int i=read_peers.size() ; i>0 ; )
 			{
 				--i;
@@ -6,6 +6,7 @@
 #include <cassert>
 
 #include <utttil/ring_buffer.hpp>
+#include <utttil/mpmc_ring_buffer.hpp>
 #include <utttil/url.hpp>
 #include <utttil/srlz.hpp>
 
@@ -44,6 +45,9 @@ struct peer_raw : peer_data<DataT>
 	inline static constexpr size_t       outbox_capacity_bits = 16;
 	inline static constexpr size_t        inbox_capacity_bits = 16;
 
+	// byte streams never wrap, messages can be (de)serialized in place
+	using byte_ring = utttil::mirrored_ring_buffer<char>;
+
 	inline peer_raw(int fd_)
 		: fd(fd_)
 		, good_(true)
@@ -76,8 +80,8 @@ struct peer_raw : peer_data<DataT>
 	virtual inline void async_write(const char*, size_t) { assert(false); }
 
 	virtual inline utttil::ring_buffer<std::shared_ptr<peer_raw<DataT>>> * get_accept_inbox() { return nullptr; }
-	virtual inline utttil::ring_buffer<char                            > * get_outbox      () { return nullptr; }
-	virtual inline utttil::ring_buffer<char                            > * get_inbox       () { return nullptr; }
+	virtual inline byte_ring                                             * get_outbox      () { return nullptr; }
+	virtual inline byte_ring                                             * get_inbox       () { return nullptr; }
 };
 
 struct no_msg_t {};
@@ -100,13 +104,6 @@ struct peer_msg : peer_data<DataT>
 template<typename MsgIn=no_msg_t, typename MsgOut=no_msg_t, typename DataT=int>
 struct peer_msgs : peer_data<DataT>
 {
-	std::vector<std::weak_ptr<utttil::ring_buffer<MsgOut>>> outboxes;
-	bool outboxes_ready = false;
-	void add_outbox(std::shared_ptr<utttil::ring_buffer<MsgOut>> & outbox_sptr) 
-	{
-		outboxes.emplace_back(outbox_sptr);
-	}
-
 	inline static constexpr size_t accept_inbox_capacity_bits =  8;
 	inline static constexpr size_t   outbox_msg_capacity_bits = 10;
 	inline static constexpr size_t    inbox_msg_capacity_bits = 10;
@@ -115,7 +112,7 @@ struct peer_msgs : peer_data<DataT>
 	virtual void async_send(      MsgOut &&) { assert(false); }
 
 	virtual utttil::ring_buffer<std::shared_ptr<peer_msgs<MsgIn,MsgOut,DataT>>> * get_accept_inbox() { return nullptr; }
-	virtual utttil::ring_buffer<MsgOut                                        > * get_outbox_msg  () { return nullptr; }
+	virtual utttil::mpmc_ring_buffer<MsgOut                                   > * get_outbox_msg  () { return nullptr; }
 	virtual utttil::ring_buffer<MsgIn                                         > * get_inbox_msg   () { return nullptr; }
 };
 
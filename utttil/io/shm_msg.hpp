@@ -0,0 +1,334 @@
+
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <type_traits>
+
+#include <utttil/ring_buffer.hpp>
+#include <utttil/url.hpp>
+
+#include <utttil/io/peer.hpp>
+
+namespace utttil {
+namespace io {
+
+// Messages cross the process boundary as raw bytes.
+template<typename C2S, typename S2C>
+inline constexpr bool shm_compatible = std::is_trivially_copyable_v<C2S> && std::is_trivially_copyable_v<S2C>;
+
+// Both rings of a shm:// connection, client to server and server to client,
+// live in one shm_open() mapping. Messages are placed in the rings as is, no
+// serialization, no syscall: MsgIn and MsgOut must be the same on both sides
+// and mustn't point outside of themselves.
+// Each end maps the segment wherever the kernel likes: the first cache line
+// of a ring, with its data pointer, sits at the end of a private page of its
+// own, the rest of the ring, its indices, at the start of the shared pages
+// that follow.
+// One server and one client at a time, each in its own process: the header
+// records their pids, a segment whose server died is taken over by the next
+// create(), a client slot whose process died by the next attach(). A client
+// waiting on its inbox should poll good() now and then, it turns false once
+// the server is gone.
+template<typename C2S, typename S2C>
+struct shm_segment
+{
+	static_assert(shm_compatible<C2S,S2C>, "shm:// messages must be trivially copyable");
+	static_assert(offsetof(ring_buffer<C2S>, front_) == ring_buffer<C2S>::cache_line_size, "only the ring's first cache line can be private");
+	static_assert(offsetof(ring_buffer<S2C>, front_) == ring_buffer<S2C>::cache_line_size, "only the ring's first cache line can be private");
+
+	inline static constexpr std::uint64_t magic = 0x75747474696c5348; // "utttilSH"
+	inline static constexpr size_t align = 64;
+
+	struct header
+	{
+		std::atomic<std::uint64_t> ready;
+		std::atomic<pid_t> server;
+		std::atomic<pid_t> connected; // the client's pid, 0 while none is attached
+		size_t size;
+		size_t sizeof_c2s;
+		size_t sizeof_s2c;
+		int c2s_bits;
+		int s2c_bits;
+	};
+
+	std::string name;
+	bool owner;
+	header * hdr;
+	size_t size;
+
+	static size_t round_up(size_t x, size_t to) { return (x + to - 1) / to * to; }
+
+	// In the file: the header, each ring but its first cache line, the data.
+	// Mapped, a private page precedes each ring's shared part.
+	static size_t page() { return ::sysconf(_SC_PAGESIZE); }
+	template<typename T>
+	static size_t shared_ring_size() { return round_up(sizeof(ring_buffer<T>) - ring_buffer<T>::cache_line_size, page()); }
+	static size_t c2s_offset()          { return round_up(sizeof(header), page()); }
+	static size_t s2c_offset()          { return c2s_offset() + shared_ring_size<C2S>(); }
+	static size_t c2s_data_offset()     { return s2c_offset() + shared_ring_size<S2C>(); }
+	static size_t s2c_data_offset(int c2s_bits) { return c2s_data_offset() + round_up(sizeof(C2S) << c2s_bits, align); }
+	static size_t total_size(int c2s_bits, int s2c_bits)
+	{
+		return round_up(s2c_data_offset(c2s_bits) + (sizeof(S2C) << s2c_bits), page());
+	}
+	static size_t mapped_size(size_t file_size) { return file_size + 2*page(); }
+
+	static header * map(int fd, size_t file_size)
+	{
+		char * base = (char*) ::mmap(nullptr, mapped_size(file_size), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED)
+			return nullptr;
+		struct piece { size_t at; size_t file_offset; size_t len; bool shared; };
+		piece pieces[] = {
+			{ 0                          , 0                , c2s_offset()            , true  },
+			{ c2s_offset()               , 0                , page()                  , false },
+			{ c2s_offset() + page()      , c2s_offset()     , shared_ring_size<C2S>() , true  },
+			{ s2c_offset() + page()      , 0                , page()                  , false },
+			{ s2c_offset() + 2*page()    , s2c_offset()     , shared_ring_size<S2C>() , true  },
+			{ c2s_data_offset() + 2*page(), c2s_data_offset(), file_size - c2s_data_offset(), true },
+		};
+		for (const piece & p : pieces)
+		{
+			void * at = p.shared
+				? ::mmap(base + p.at, p.len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, p.file_offset)
+				: ::mmap(base + p.at, p.len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+			if (at == MAP_FAILED)
+			{
+				::munmap(base, mapped_size(file_size));
+				return nullptr;
+			}
+		}
+		return (header*) base;
+	}
+	// what the private cache line of a ring holds, in this process
+	template<typename T>
+	static void view(ring_buffer<T> * rb, int bits, T * data)
+	{
+		rb->Capacity = size_t(1) << bits;
+		rb->Mask = rb->Capacity - 1;
+		rb->data = data;
+		rb->owns_data = false;
+	}
+
+	static bool alive(pid_t pid)
+	{
+		return pid != 0 && (::kill(pid, 0) == 0 || errno == EPERM);
+	}
+
+	shm_segment(const utttil::url & url)
+		: name("/" + url.host)
+		, owner(false)
+		, hdr(nullptr)
+		, size(0)
+	{}
+	~shm_segment()
+	{
+		close();
+	}
+
+	ring_buffer<C2S> * c2s() { return (ring_buffer<C2S>*)((char*)hdr + c2s_offset() +   page() - ring_buffer<C2S>::cache_line_size); }
+	ring_buffer<S2C> * s2c() { return (ring_buffer<S2C>*)((char*)hdr + s2c_offset() + 2*page() - ring_buffer<S2C>::cache_line_size); }
+	C2S * c2s_data() { return (C2S*)((char*)hdr + 2*page() + c2s_data_offset()); }
+	S2C * s2c_data() { return (S2C*)((char*)hdr + 2*page() + s2c_data_offset(hdr->c2s_bits)); }
+
+	// true if name is left over by a server that died, false if it is in use
+	// or still being created
+	bool stale()
+	{
+		int fd = ::shm_open(name.c_str(), O_RDONLY, 0600);
+		if (fd == -1)
+			return errno == ENOENT;
+		struct stat st;
+		header * h = (header*) MAP_FAILED;
+		if (::fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(header))
+			h = (header*) ::mmap(nullptr, sizeof(header), PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (h == MAP_FAILED)
+			return false;
+		pid_t server = h->server.load(std::memory_order_acquire);
+		::munmap(h, sizeof(header));
+		return server != 0 && ! alive(server);
+	}
+
+	bool create(int c2s_bits, int s2c_bits)
+	{
+		int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd == -1 && errno == EEXIST && stale())
+		{
+			::shm_unlink(name.c_str());
+			fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		}
+		if (fd == -1)
+		{
+			std::cout << "shm_open() " << name << " " << ::strerror(errno) << std::endl;
+			return false;
+		}
+		size = total_size(c2s_bits, s2c_bits);
+		header * h = nullptr;
+		if (::ftruncate(fd, size) == 0)
+			h = map(fd, size);
+		::close(fd);
+		if (h == nullptr)
+		{
+			std::cout << "shm mmap() " << name << " " << ::strerror(errno) << std::endl;
+			::shm_unlink(name.c_str());
+			return false;
+		}
+		hdr = h;
+		owner = true;
+		hdr->server.store(::getpid(), std::memory_order_release);
+		hdr->c2s_bits = c2s_bits;
+		hdr->s2c_bits = s2c_bits;
+
+		std::uninitialized_default_construct_n(c2s_data(), size_t(1) << c2s_bits);
+		std::uninitialized_default_construct_n(s2c_data(), size_t(1) << s2c_bits);
+		new (c2s()) ring_buffer<C2S>(c2s_bits, c2s_data());
+		new (s2c()) ring_buffer<S2C>(s2c_bits, s2c_data());
+
+		hdr->connected.store(0, std::memory_order_relaxed);
+		hdr->size = size;
+		hdr->sizeof_c2s = sizeof(C2S);
+		hdr->sizeof_s2c = sizeof(S2C);
+		hdr->ready.store(magic, std::memory_order_release);
+		return true;
+	}
+
+	bool attach()
+	{
+		int fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+		if (fd == -1)
+			return false;
+		struct stat st;
+		header * h = nullptr;
+		if (::fstat(fd, &st) == 0 && (size_t)st.st_size >= c2s_data_offset())
+			h = map(fd, st.st_size);
+		::close(fd);
+		if (h == nullptr)
+			return false;
+		if (   h->ready.load(std::memory_order_acquire) != magic
+		    || h->size != (size_t)st.st_size
+		    || h->size != total_size(h->c2s_bits, h->s2c_bits)
+		    || h->sizeof_c2s != sizeof(C2S)
+		    || h->sizeof_s2c != sizeof(S2C)
+		    || ! alive(h->server.load(std::memory_order_acquire)))
+		{
+			std::cout << "shm segment " << name << " not ready, for other message types or without server" << std::endl;
+			::munmap(h, mapped_size(st.st_size));
+			return false;
+		}
+		pid_t expected = 0;
+		while ( ! h->connected.compare_exchange_strong(expected, ::getpid(), std::memory_order_acq_rel))
+		{
+			if (alive(expected))
+			{
+				std::cout << "shm segment " << name << " already has a client, pid " << expected << std::endl;
+				::munmap(h, mapped_size(st.st_size));
+				return false;
+			}
+			// expected now holds the dead client's pid, take its place
+		}
+		hdr = h;
+		size = st.st_size;
+		view(c2s(), hdr->c2s_bits, c2s_data());
+		view(s2c(), hdr->s2c_bits, s2c_data());
+		return true;
+	}
+
+	void close()
+	{
+		if (hdr == nullptr)
+			return;
+		if (owner)
+			hdr->server.store(0, std::memory_order_release);
+		else
+		{
+			pid_t self = ::getpid();
+			hdr->connected.compare_exchange_strong(self, 0, std::memory_order_acq_rel);
+		}
+		::munmap(hdr, mapped_size(size));
+		hdr = nullptr;
+		if (owner)
+			::shm_unlink(name.c_str());
+	}
+	// for a client, also whether the server is still there
+	bool good() const
+	{
+		return hdr != nullptr && (owner || alive(hdr->server.load(std::memory_order_acquire)));
+	}
+};
+
+// The io threads have nothing to do, the application reads and writes the
+// shared rings directly.
+template<typename MsgIn=no_msg_t, typename MsgOut=no_msg_t, typename DataT=int>
+struct shm_server_msg : peer_msg<MsgIn,MsgOut,DataT>
+{
+	shm_segment<MsgIn,MsgOut> segment;
+
+	shm_server_msg(const utttil::url & url)
+		: segment(url)
+	{
+		segment.create(peer_msg<MsgIn,MsgOut,DataT>::inbox_msg_capacity_bits, peer_msg<MsgIn,MsgOut,DataT>::outbox_msg_capacity_bits);
+	}
+
+	void close() override { segment.close(); }
+	bool good() const override { return segment.good(); }
+
+	utttil::ring_buffer<MsgOut> * get_outbox_msg() override { return segment.s2c(); }
+	utttil::ring_buffer<MsgIn > * get_inbox_msg () override { return segment.c2s(); }
+
+	void   pack() override {}
+	bool unpack() override { return false; }
+
+	void async_send(const MsgOut & msg) override
+	{
+		segment.s2c()->push_back(msg);
+	}
+	void async_send(MsgOut && msg) override
+	{
+		segment.s2c()->push_back(std::move(msg));
+	}
+};
+
+template<typename MsgIn=no_msg_t, typename MsgOut=no_msg_t, typename DataT=int>
+struct shm_client_msg : peer_msg<MsgIn,MsgOut,DataT>
+{
+	shm_segment<MsgOut,MsgIn> segment;
+
+	shm_client_msg(const utttil::url & url)
+		: segment(url)
+	{
+		segment.attach();
+	}
+
+	void close() override { segment.close(); }
+	bool good() const override { return segment.good(); }
+
+	utttil::ring_buffer<MsgOut> * get_outbox_msg() override { return segment.c2s(); }
+	utttil::ring_buffer<MsgIn > * get_inbox_msg () override { return segment.s2c(); }
+
+	void   pack() override {}
+	bool unpack() override { return false; }
+
+	void async_send(const MsgOut & msg) override
+	{
+		segment.c2s()->push_back(msg);
+	}
+	void async_send(MsgOut && msg) override
+	{
+		segment.c2s()->push_back(std::move(msg));
+	}
+};
+
+}} // namespace
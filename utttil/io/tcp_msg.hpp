@@ -66,9 +66,9 @@ struct tcp_socket_msg : peer_msg<MsgIn,MsgOut,DataT>
 	{
 		auto & outbox = *raw.get_outbox();
 
-		while ( ! outbox_msg.empty())
+		while (MsgOut * msg_ptr = outbox_msg.try_front())
 		{
-			MsgOut & msg = outbox_msg.front();
+			MsgOut & msg = *msg_ptr;
 
 			auto size_preview_serializer = utttil::srlz::to_binary(utttil::srlz::device::null_writer());
 			size_preview_serializer << msg;
@@ -80,9 +80,7 @@ struct tcp_socket_msg : peer_msg<MsgIn,MsgOut,DataT>
 				break;
 
 			try {
-				auto stretch1 = outbox.back_stretch();
-				auto stretch2 = outbox.back_stretch_2();
-				auto s = utttil::srlz::to_binary(utttil::srlz::device::ring_buffer_writer(stretch1, stretch2, total_size));
+				auto s = utttil::srlz::to_binary(utttil::srlz::device::ptr_writer(std::get<0>(outbox.back_stretch())));
 				s << msg_size;
 				s << msg;
 				outbox.advance_back(s.write.size());
@@ -96,11 +94,12 @@ struct tcp_socket_msg : peer_msg<MsgIn,MsgOut,DataT>
 	bool unpack() override
 	{
 		auto & inbox = *raw.get_inbox();
-		auto initial_inbox_msg_position = inbox_msg.back_;
+		size_t initial_inbox_msg_position = inbox_msg.back_;
 
 		while ( ! inbox_msg.full() && ! inbox.empty())
 		{
-			auto deserializer = utttil::srlz::from_binary(utttil::srlz::device::ring_buffer_reader(inbox, inbox.size()));
+			auto [inbox_ptr, inbox_size] = inbox.front_stretch();
+			auto deserializer = utttil::srlz::from_binary(utttil::srlz::device::ptr_reader(inbox_ptr, inbox_size));
 			size_t msg_size;
 			size_t total_size;
 			try {
@@ -111,7 +110,7 @@ struct tcp_socket_msg : peer_msg<MsgIn,MsgOut,DataT>
 				break;
 			}
 			total_size = msg_size + deserializer.read.size();
-			if (total_size > inbox.size()) {
+			if (total_size > inbox_size) {
 				break;
 			}
 			MsgIn & msg = inbox_msg.back();
@@ -19,26 +19,30 @@ namespace utttil {
 namespace io {
 
 // Multiple-producers variant of tcp_socket_msg
-// User of this class must add outboxes before sending messages
+// Any number of threads may async_send() into the shared outbox_msg
 
 template<typename MsgIn, typename MsgOut, typename DataT=int>
 struct tcp_socket_msgs : peer_msgs<MsgIn,MsgOut,DataT>
 {
 	tcp_socket_raw<DataT> raw;
 
-	utttil::ring_buffer<MsgIn> inbox_msg;
+	utttil::mpmc_ring_buffer<MsgOut> outbox_msg;
+	utttil::ring_buffer     <MsgIn > inbox_msg;
 
 	tcp_socket_msgs(int fd)
 		: raw(fd)
-		, inbox_msg (peer_msg<MsgIn,MsgOut,DataT>:: inbox_msg_capacity_bits)
+		, outbox_msg(peer_msgs<MsgIn,MsgOut,DataT>::outbox_msg_capacity_bits)
+		, inbox_msg (peer_msgs<MsgIn,MsgOut,DataT>:: inbox_msg_capacity_bits)
 	{}
 	tcp_socket_msgs(const utttil::url & url)
 		: raw(url)
-		, inbox_msg (peer_msg<MsgIn,MsgOut,DataT>:: inbox_msg_capacity_bits)
+		, outbox_msg(peer_msgs<MsgIn,MsgOut,DataT>::outbox_msg_capacity_bits)
+		, inbox_msg (peer_msgs<MsgIn,MsgOut,DataT>:: inbox_msg_capacity_bits)
 	{}
 	tcp_socket_msgs(tcp_socket_raw<DataT> && other)
 		: raw(std::move(other))
-		, inbox_msg (peer_msg<MsgIn,MsgOut,DataT>:: inbox_msg_capacity_bits)
+		, outbox_msg(peer_msgs<MsgIn,MsgOut,DataT>::outbox_msg_capacity_bits)
+		, inbox_msg (peer_msgs<MsgIn,MsgOut,DataT>:: inbox_msg_capacity_bits)
 	{}
 
 	bool does_accept() override { return false; }
@@ -48,7 +52,8 @@ struct tcp_socket_msgs : peer_msgs<MsgIn,MsgOut,DataT>
 	void close() override { return raw.close(); }
 	bool good() const override { return raw.good(); }
 
-	utttil::ring_buffer<MsgIn > * get_inbox_msg() override { return & inbox_msg; }
+	utttil::mpmc_ring_buffer<MsgOut> * get_outbox_msg() override { return &outbox_msg; }
+	utttil::ring_buffer     <MsgIn > * get_inbox_msg () override { return & inbox_msg; }
 
 	int write() override
 	{
@@ -61,54 +66,44 @@ struct tcp_socket_msgs : peer_msgs<MsgIn,MsgOut,DataT>
 
 	void pack() override
 	{
-		if ( ! this->outboxes_ready)
-			return;
-
 		auto & outbox = *raw.get_outbox();
 		
-		for (auto & outbox_msg_wptr : this->outboxes)
+		while ( ! outbox_msg.empty())
 		{
-			auto outbox_msg = outbox_msg_wptr.lock();
-			if ( ! outbox_msg)
-				continue;
-			while ( ! outbox_msg->empty())
-			{
-				MsgOut & msg = outbox_msg->front();
-
-				std::cout << "======= tcp msgs Packing: " << msg << std::endl;
-
-				auto size_preview_serializer = utttil::srlz::to_binary(utttil::srlz::device::null_writer());
-				size_preview_serializer << msg;
-				size_t msg_size = size_preview_serializer.write.size();
-				size_preview_serializer << msg_size; // add size field
-				size_t total_size = size_preview_serializer.write.size();
-
-				if (outbox.free_size() < total_size)
-					break;
-
-				try {
-					auto stretch1 = outbox.back_stretch();
-					auto stretch2 = outbox.back_stretch_2();
-					auto s = utttil::srlz::to_binary(utttil::srlz::device::ring_buffer_writer(stretch1, stretch2, total_size));
-					s << msg_size;
-					s << msg;
-					outbox.advance_back(s.write.size());
-					outbox_msg->pop_front();
-				} catch (utttil::srlz::device::stream_end_exception &) {
-					std::cout << __func__ << " stream_end_exception" << std::endl;
-					return;
-				}
+			MsgOut & msg = outbox_msg.front();
+
+			std::cout << "======= tcp msgs Packing: " << msg << std::endl;
+
+			auto size_preview_serializer = utttil::srlz::to_binary(utttil::srlz::device::null_writer());
+			size_preview_serializer << msg;
+			size_t msg_size = size_preview_serializer.write.size();
+			size_preview_serializer << msg_size; // add size field
+			size_t total_size = size_preview_serializer.write.size();
+
+			if (outbox.free_size() < total_size)
+				break;
+
+			try {
+				auto s = utttil::srlz::to_binary(utttil::srlz::device::ptr_writer(std::get<0>(outbox.back_stretch())));
+				s << msg_size;
+				s << msg;
+				outbox.advance_back(s.write.size());
+				outbox_msg.pop_front();
+			} catch (utttil::srlz::device::stream_end_exception &) {
+				std::cout << __func__ << " stream_end_exception" << std::endl;
+				return;
 			}
 		}
 	}
 	bool unpack() override
 	{
 		auto & inbox = *raw.get_inbox();
-		auto initial_inbox_msg_position = inbox_msg.back_;
+		size_t initial_inbox_msg_position = inbox_msg.back_;
 
 		while ( ! inbox_msg.full() && ! inbox.empty())
 		{
-			auto deserializer = utttil::srlz::from_binary(utttil::srlz::device::ring_buffer_reader(inbox, inbox.size()));
+			auto [inbox_ptr, inbox_size] = inbox.front_stretch();
+			auto deserializer = utttil::srlz::from_binary(utttil::srlz::device::ptr_reader(inbox_ptr, inbox_size));
 			size_t msg_size;
 			size_t total_size;
 			try {
@@ -119,7 +114,7 @@ struct tcp_socket_msgs : peer_msgs<MsgIn,MsgOut,DataT>
 				break;
 			}
 			total_size = msg_size + deserializer.read.size();
-			if (total_size > inbox.size()) {
+			if (total_size > inbox_size) {
 				break;
 			}
 			MsgIn & msg = inbox_msg.back();
@@ -136,6 +131,14 @@ struct tcp_socket_msgs : peer_msgs<MsgIn,MsgOut,DataT>
 		}
 		return inbox_msg.back_ != initial_inbox_msg_position;
 	}
+	void async_send(const MsgOut & msg) override
+	{
+		outbox_msg.push_back(msg);
+	}
+	void async_send(MsgOut && msg) override
+	{
+		outbox_msg.push_back(std::move(msg));
+	}
 };
 
 template<typename MsgIn=no_msg_t, typename MsgOut=no_msg_t, typename DataT=int>
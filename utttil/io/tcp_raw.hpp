@@ -101,8 +101,8 @@ inline int client_socket_tcp(const std::string & addr, int port)
 template<typename DataT=int>
 struct tcp_socket_raw : peer_raw<DataT>
 {
-	utttil::ring_buffer<char> outbox;
-	utttil::ring_buffer<char>  inbox;
+	typename peer_raw<DataT>::byte_ring outbox;
+	typename peer_raw<DataT>::byte_ring  inbox;
 
 	tcp_socket_raw(int fd_)
 		: peer_raw<DataT>(fd_)
@@ -124,8 +124,8 @@ struct tcp_socket_raw : peer_raw<DataT>
 	bool does_read  () override { return true ; }
 	bool does_write () override { return true ; }
 
-	utttil::ring_buffer<char> * get_outbox() override { return &outbox ; }
-	utttil::ring_buffer<char> * get_inbox () override { return & inbox ; }
+	typename peer_raw<DataT>::byte_ring * get_outbox() override { return &outbox ; }
+	typename peer_raw<DataT>::byte_ring * get_inbox () override { return & inbox ; }
 
 	void print_inbox()
 	{
@@ -45,11 +45,12 @@ struct udpm_client_msg : peer_msg<MsgIn,MsgOut,DataT>
 	bool unpack() override
 	{
 		auto & inbox = *raw.get_inbox();
-		auto initial_inbox_msg_position = inbox_msg.back_;
+		size_t initial_inbox_msg_position = inbox_msg.back_;
 
 		while ( ! inbox_msg.full())
 		{
-			auto deserializer = utttil::srlz::from_binary(utttil::srlz::device::ring_buffer_reader(inbox, inbox.size()));
+			auto [inbox_ptr, inbox_size] = inbox.front_stretch();
+			auto deserializer = utttil::srlz::from_binary(utttil::srlz::device::ptr_reader(inbox_ptr, inbox_size));
 			size_t msg_size;
 			size_t total_size;
 			try {
@@ -58,7 +59,7 @@ struct udpm_client_msg : peer_msg<MsgIn,MsgOut,DataT>
 				break;
 			}
 			total_size = msg_size + deserializer.read.size();
-			if (total_size > inbox.size()) {
+			if (total_size > inbox_size) {
 				break;
 			}
 			MsgIn & msg = inbox_msg.back();
@@ -146,34 +147,36 @@ struct udpm_server_msg : peer_msg<MsgIn,MsgOut,DataT>
 		return count;
 	}
 
+	// appends msg to the datagram being built, false if it doesn't fit
+	bool pack_msg(const MsgOut & msg)
+	{
+		auto size_preview_serializer = utttil::srlz::to_binary(utttil::srlz::device::null_writer());
+		size_preview_serializer << msg;
+		size_t msg_size = size_preview_serializer.write.size();
+		size_preview_serializer << msg_size; // add size field
+		size_t total_size = size_preview_serializer.write.size();
+
+		if (sizeof(send_buffer)-send_size < total_size) {
+			return false;
+		}
+		try {
+			auto s = utttil::srlz::to_binary(utttil::srlz::device::ptr_writer(&send_buffer[send_size]));
+			s << msg_size;
+			s << msg;
+			send_size += s.write.size();
+		} catch (utttil::srlz::device::stream_end_exception &) {
+			std::cout << this->fd << " udpm_server_msg send() stream_end_exception" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
 	void pack() override
 	{
 		if (send_size != 0)
 			return;
-		while ( ! outbox_msg.empty())
-		{
-			MsgOut & msg = outbox_msg.front();
-
-			auto size_preview_serializer = utttil::srlz::to_binary(utttil::srlz::device::null_writer());
-			size_preview_serializer << msg;
-			size_t msg_size = size_preview_serializer.write.size();
-			size_preview_serializer << msg_size; // add size field
-			size_t total_size = size_preview_serializer.write.size();
-
-			if (sizeof(send_buffer)-send_size < total_size) {
-				return;
-			}
-			try {
-				auto s = utttil::srlz::to_binary(utttil::srlz::device::ptr_writer(&send_buffer[send_size]));
-				s << msg_size;
-				s << msg;
-				send_size += s.write.size();
-				outbox_msg.pop_front();
-			} catch (utttil::srlz::device::stream_end_exception &) {
-				std::cout << this->fd << " udpm_server_msg send() stream_end_exception" << std::endl;
-				return;
-			}
-		}
+		while ( ! outbox_msg.empty() && pack_msg(outbox_msg.front()))
+			outbox_msg.pop_front();
 	}
 
 	void async_send(const MsgOut & msg) override
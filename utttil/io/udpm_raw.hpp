@@ -71,7 +71,7 @@ inline int client_socket_udpm(const std::string & addr, int port)
 template<typename DataT=int>
 struct udpm_client_raw : peer_raw<DataT>
 {
-	utttil::ring_buffer<char> inbox;
+	typename peer_raw<DataT>::byte_ring inbox;
 
 	udpm_client_raw(const utttil::url & url)
 		: peer_raw<DataT>(client_socket_udpm(url.host.c_str(), std::stoull(url.port)))
@@ -82,7 +82,7 @@ struct udpm_client_raw : peer_raw<DataT>
 	bool does_read  () override { return true ; }
 	bool does_write () override { return false; }
 
-	utttil::ring_buffer<char> * get_inbox () override { return & inbox ; }
+	typename peer_raw<DataT>::byte_ring * get_inbox () override { return & inbox ; }
 	
 	int read() override
 	{
@@ -108,7 +108,7 @@ struct udpm_server_raw : peer_raw<DataT>
 	sockaddr_in *sendto_addr_ptr;
 	size_t sendto_addr_len;
 
-	utttil::ring_buffer<char> outbox;
+	typename peer_raw<DataT>::byte_ring outbox;
 
 	udpm_server_raw(const utttil::url & url)
 		: peer_raw<DataT>(server_socket_udpm())
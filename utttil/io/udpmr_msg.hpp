@@ -9,8 +9,10 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <deque>
+#include <optional>
 
 #include <utttil/ring_buffer.hpp>
+#include <utttil/broadcast_ring.hpp>
 #include <utttil/url.hpp>
 #include <utttil/srlz.hpp>
 
@@ -282,7 +284,7 @@ struct udpmr_client_msg : peer_msg<MsgIn,MsgOut,DataT>
 	{
 		// handle TCP msgs
 		replay_client.unpack();
-		auto initial_inbox_msg_position = inbox_msg.back_;
+		size_t initial_inbox_msg_position = inbox_msg.back_;
 
 		if (inbox_msg.full()) {
 			return false;
@@ -325,7 +327,7 @@ struct udpmr_client_msg : peer_msg<MsgIn,MsgOut,DataT>
 			if (inbox_msg.free_size() < msg_count)
 				break;
 	
-			auto checkpoint = inbox_msg.back_;
+			size_t checkpoint = inbox_msg.back_;
 			auto deserializer = utttil::srlz::from_binary(utttil::srlz::device::ptr_reader(&f.data[0], f.size));
 			try {
 				size_t msg_size;
@@ -366,16 +368,28 @@ struct udpmr_server_msg : peer_msg<MsgIn,MsgOut,DataT>
 
 	udpm_server_msg<MsgIn,MsgOut> multicast_server;
 	tcp_server_msg<ReplayRequest<Seq>,ReplayResponse<Seq,MsgOut>,DataT> replay_server;
-	std::deque<std::shared_ptr<tcp_socket_msg<ReplayRequest<Seq>,ReplayResponse<Seq,MsgOut>,DataT>>> replay_clients;
+	// a replay longer than the client's outbox goes out over several pack()
+	struct replay_client
+	{
+		std::shared_ptr<tcp_socket_msg<ReplayRequest<Seq>,ReplayResponse<Seq,MsgOut>,DataT>> socket;
+		int req_id = 0;
+		size_t pos = 0; // in history, up to end
+		size_t end = 0;
+		Seq end_seq;
+	};
+	std::deque<replay_client> replay_clients;
 
 	utttil::ring_buffer<MsgOut> outbox_msg;
-	typename utttil::ring_buffer<MsgOut>::iterator sent_it;
+	// everything sent, kept for replays. The multicast is one of its readers.
+	utttil::broadcast_ring<MsgOut> history;
+	typename utttil::broadcast_ring<MsgOut>::reader multicast_reader;
 
 	udpmr_server_msg(const utttil::url & url_udp, const utttil::url & url_tcp)
 		: multicast_server(url_udp)
 		, replay_server(url_tcp)
-		, outbox_msg(24) // make it allocate a fixed size in bytes using sizeof() and such?
-		, sent_it(outbox_msg.begin())
+		, outbox_msg(peer_msg<MsgIn,MsgOut,DataT>::outbox_msg_capacity_bits)
+		, history(24) // make it allocate a fixed size in bytes using sizeof() and such?
+		, multicast_reader(history.make_reader())
 	{
 		//std::cout << "fd: " << multicast_server.fd << " url: " << url_udp.to_string() << std::endl;
 		//std::cout << "fd: " << replay_server   .fd << " url: " << url_tcp.to_string() << std::endl;
@@ -387,7 +401,7 @@ struct udpmr_server_msg : peer_msg<MsgIn,MsgOut,DataT>
 
 	utttil::ring_buffer<MsgOut> * get_outbox_msg  () override { return &outbox_msg; }
 
-	void close() override { multicast_server.close(); replay_server.close(); for (auto & c:replay_clients) c->close(); }
+	void close() override { multicast_server.close(); replay_server.close(); for (auto & c:replay_clients) c.socket->close(); }
 	bool good() const override { return multicast_server.good() & replay_server.good(); }
 
 	std::shared_ptr<peer> accept() override
@@ -396,14 +410,15 @@ struct udpmr_server_msg : peer_msg<MsgIn,MsgOut,DataT>
 		if ( ! new_peer_sptr)
 			return nullptr;
 		replay_server.get_accept_inbox()->pop_front();
-		replay_clients.push_back(std::dynamic_pointer_cast<tcp_socket_msg<ReplayRequest<Seq>,ReplayResponse<Seq,MsgOut>,DataT>>(new_peer_sptr));
+		replay_clients.emplace_back();
+		replay_clients.back().socket = std::dynamic_pointer_cast<tcp_socket_msg<ReplayRequest<Seq>,ReplayResponse<Seq,MsgOut>,DataT>>(new_peer_sptr);
 		return new_peer_sptr;
 	}
 
 	int write() override
 	{
 		for (int i=replay_clients.size()-1 ; i>=0 ; --i)
-			replay_clients[i]->write();
+			replay_clients[i].socket->write();
 		return multicast_server.write();
 	}
 	int read() override
@@ -411,10 +426,10 @@ struct udpmr_server_msg : peer_msg<MsgIn,MsgOut,DataT>
 		int count = 0;
 		for (int i=replay_clients.size()-1 ; i>=0 ; --i)
 		{
-			int read = replay_clients[i]->read();
+			int read = replay_clients[i].socket->read();
 			if (read > 0)
 				count += read;
-			else if ( ! replay_clients[i]->good())
+			else if ( ! replay_clients[i].socket->good())
 				replay_clients.erase(replay_clients.begin() + i);
 		}
 		return count;
@@ -422,65 +437,97 @@ struct udpmr_server_msg : peer_msg<MsgIn,MsgOut,DataT>
 
 	void pack() override
 	{
-		while(sent_it < outbox_msg.end() && ! multicast_server.get_outbox_msg()->full())
-			multicast_server.get_outbox_msg()->push_back(*sent_it++);
-		multicast_server.pack();
+		// never lap our own multicast, outbox_msg pushes back on the app instead
+		size_t n = std::min(outbox_msg.size(), history.capacity() - multicast_reader.size());
+		for ( ; n>0 ; --n)
+		{
+			history.push_back(std::move(outbox_msg.front()));
+			outbox_msg.pop_front();
+		}
+		serve_replays();
+		if (multicast_server.send_size == 0)
+			while ( ! multicast_reader.empty() && multicast_server.pack_msg(multicast_reader.front()))
+				multicast_reader.pop_front();
 		for (int i=replay_clients.size()-1 ; i>=0 ; --i)
-			replay_clients[i]->pack();
+			replay_clients[i].socket->pack();
 	}
 	bool unpack() override
 	{
 		bool some_unpacked = false;
 		for (int i=replay_clients.size()-1 ; i>=0 ; --i)
+			some_unpacked |= replay_clients[i].socket->unpack();
+		return some_unpacked;
+	}
+
+	// Runs from pack(), on the writer's thread: history.at() would race
+	// push_back() from anywhere else. Only this thread drains the clients'
+	// outboxes, so a full one leaves the rest of the replay to the next pack().
+	void serve_replays()
+	{
+		for (replay_client & c : replay_clients)
 		{
-			some_unpacked |= replay_clients[i]->unpack();
-			if ( ! replay_clients[i]->get_inbox_msg()->empty())
+			auto & inbox  = *c.socket->get_inbox_msg();
+			auto & outbox = *c.socket->get_outbox_msg();
+			for (;;)
 			{
-				ReplayRequest<Seq> & req = replay_clients[i]->get_inbox_msg()->front();
-				std::cout << "ReplayRequest " << req.req_id << ": " << req.begin << " - " << req.end << std::endl;
-				if (too_old(req.begin) || too_old(req.end))
+				ReplayResponse<Seq,MsgOut> resp;
+				if (c.pos == c.end)
 				{
-					std::cout << "ReplayRequest " << req.req_id << ": can't be honored, too old" << std::endl;
-					// can't honor request
-					ReplayResponse<Seq,MsgOut> & resp = replay_clients[i]->get_outbox_msg()->back();
+					if (inbox.empty())
+						break;
+					ReplayRequest<Seq> & req = inbox.front();
+					std::cout << "ReplayRequest " << req.req_id << ": " << req.begin << " - " << req.end << std::endl;
 					resp.req_id = req.req_id;
-					resp.status = 2;
-					resp.available_begin  = req.end;
-					resp.available_end    = req.end;
-					replay_clients[i]->get_outbox_msg()->advance_back();
+					if (too_old(req.begin) || too_old(req.end))
+					{
+						std::cout << "ReplayRequest " << req.req_id << ": can't be honored, too old" << std::endl;
+						resp.status = 2;
+						resp.available_begin  = req.end;
+						resp.available_end    = req.end;
+						if ( ! outbox.try_push(resp))
+							break;
+					}
+					else if (too_new(req.begin) || too_new(req.end))
+					{
+						std::cout << "ReplayRequest " << req.req_id << ": can't be honored, too new" << std::endl;
+						resp.status = 1;
+						resp.available_begin  = req.begin;
+						resp.available_end    = req.begin;
+						if ( ! outbox.try_push(resp))
+							break;
+					}
+					else
+					{
+						std::cout << "ReplayRequest " << req.req_id << ": ok" << std::endl;
+						c.req_id  = req.req_id;
+						c.pos     = get_position(req.begin);
+						c.end     = get_position(req.end  );
+						c.end_seq = req.end;
+					}
+					inbox.pop_front();
 				}
-				else if (too_new(req.begin) || too_new(req.end))
+				else if (c.pos < history.begin())
 				{
-					std::cout << "ReplayRequest " << req.req_id << ": can't be honored, too new" << std::endl;
-					// can't honor request
-					ReplayResponse<Seq,MsgOut> & resp = replay_clients[i]->get_outbox_msg()->back();
-					resp.status = 1;
-					resp.req_id = req.req_id;
-					resp.available_begin  = req.begin;
-					resp.available_end    = req.begin;
-					replay_clients[i]->get_outbox_msg()->advance_back();
+					// lapped while the client was slow to take it
+					resp.req_id = c.req_id;
+					resp.status = 2;
+					resp.available_begin  = c.end_seq;
+					resp.available_end    = c.end_seq;
+					if ( ! outbox.try_push(resp))
+						break;
+					c.pos = c.end;
 				}
 				else
 				{
-					std::cout << "ReplayRequest " << req.req_id << ": ok" << std::endl;
-					auto it  = get_iterator(req.begin);
-					auto end = get_iterator(req.end  );
-					for ( ; it!=end ; ++it)
-					{
-						ReplayResponse<Seq,MsgOut> & resp = replay_clients[i]->get_outbox_msg()->back();
-						resp.req_id  = req.req_id;
-						resp.status  = 0;
-						resp.payload = *it;
-						replay_clients[i]->get_outbox_msg()->advance_back();
-					}
+					resp.req_id  = c.req_id;
+					resp.status  = 0;
+					resp.payload = history.at(c.pos);
+					if ( ! outbox.try_push(resp))
+						break;
+					++c.pos;
 				}
-				replay_clients[i]->get_inbox_msg()->pop_front();
 			}
 		}
-		if (outbox_msg.free_size() < outbox_msg.capacity()/1024) // totally arbitrary number
-			if (outbox_msg.begin() + outbox_msg.capacity()/1024 <= sent_it)
-				outbox_msg.advance_front(outbox_msg.capacity()/1024);
-		return some_unpacked;
 	}
 
 	virtual void async_send(const MsgOut & msg)
@@ -494,15 +541,15 @@ struct udpmr_server_msg : peer_msg<MsgIn,MsgOut,DataT>
 
 	bool too_old(Seq seq)
 	{
-		return outbox_msg.empty() || seq < outbox_msg.front().get_seq();
+		return history.empty() || seq < history.at(history.begin()).get_seq();
 	}
 	bool too_new(Seq seq)
 	{
-		return outbox_msg.empty() || (outbox_msg.begin()+(outbox_msg.size()-1))->get_seq() < seq;
+		return history.empty() || history.at(history.end()-1).get_seq() < seq;
 	}
-	auto get_iterator(Seq seq)
+	size_t get_position(Seq seq)
 	{
-		return outbox_msg.begin() + (seq - outbox_msg.front().get_seq()).value();
+		return history.begin() + (seq - history.at(history.begin()).get_seq()).value();
 	}
 };
 
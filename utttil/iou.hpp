@@ -5,6 +5,10 @@
 #include <arpa/inet.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <immintrin.h>
 
 #include <chrono>
@@ -17,7 +21,6 @@
 #include <functional>
 #include <memory>
 #include <iterator>
-#include <map>
 
 #include <liburing.h>
 
@@ -25,35 +28,349 @@
 #include <utttil/srlz.hpp>
 #include <utttil/no_init.hpp>
 #include <utttil/on_scope_exit.hpp>
+#include <utttil/spinlock.hpp>
+#include <utttil/mpmc_ring_buffer.hpp>
 
 #include <utttil/iou/peer.hpp>
 
 namespace utttil {
 namespace iou {
 
+// io_uring setup knobs, all off by default
+struct context_config
+{
+	unsigned queue_depth = 16384;
+	unsigned max_peers = 65536;     // size of the peer table, at most 1<<24
+	int cpu = -1;                   // pins the io thread
+	bool sqpoll = false;            // a kernel thread polls the SQ, no io_uring_enter() to submit
+	int sqpoll_cpu = -1;            // pins that thread
+	unsigned sq_thread_idle = 1000; // ms before that thread sleeps
+	bool single_issuer = false;     // only the io thread submits, lets the kernel skip its locking
+	bool coop_taskrun = false;
+	bool defer_taskrun = false;     // implies single_issuer
+	// Peers can take one of max_registered_peers slots, for their socket
+	// as a fixed file and/or their inbox/outbox as fixed buffers.
+	unsigned max_registered_peers = 0;
+	bool fixed_files = false;
+	bool fixed_buffers = false;
+	// one accept SQE per acceptor rather than one per connection
+	bool multishot_accept = false;
+	// One recv SQE per peer, reading into recv_buffer_count buffers shared by
+	// all peers instead of a read posted on each peer's inbox.
+	bool multishot_recv = false;
+	unsigned recv_buffer_count = 1024; // power of 2
+	unsigned recv_buffer_size = 4096;
+	// async_send_zc() copies anything smaller, SIZE_MAX turns SEND_ZC off
+	size_t send_zc_threshold = 16384;
+};
+
 template<typename MsgT=no_msg_t>
 struct context
 {
 	io_uring ring;
+	context_config config;
 	std::thread t;
 	std::atomic_bool go_on = true;
-	std::map<size_t, std::weak_ptr<peer<MsgT>>> peers;
-	size_t next_id = 1;
 
-	context()
+	// Peer ids are generation << entry_bits | entry in the table below, so
+	// that a completion finds its peer by index, and one for a peer that has
+	// been forgotten since finds a newer generation. The table holds the
+	// peers alive until they are forgotten. 0 is the context itself.
+	struct peer_entry
+	{
+		std::atomic<std::uint32_t> generation = 1;
+		peer<MsgT> * ptr = nullptr; // io thread only, as the two below
+		std::shared_ptr<peer<MsgT>> keep;
+		int registered = -1;        // slot taken by register_peer()
+	};
+	inline static constexpr unsigned entry_bits = 24;
+	inline static constexpr size_t entry_mask = (size_t(1) << entry_bits) - 1;
+	// what user_data leaves above the Action, below the tag
+	inline static constexpr unsigned generation_bits = tag_shift - 3 - entry_bits;
+	inline static constexpr size_t id_mask = (size_t(1) << (entry_bits + generation_bits)) - 1;
+	std::unique_ptr<peer_entry[]> table;
+	size_t table_capacity;
+	utttil::spinlock table_lock;
+	std::vector<std::uint32_t> free_entries; // under table_lock
+	inline static constexpr unsigned cqe_batch_size = 256;
+	int doorbell_fd;
+	eventfd_t doorbell_value;
+	// ids of the parked writers that wake_writer() woke, drained on the doorbell
+	utttil::mpmc_ring_buffer<size_t> woken;
+
+	std::vector<int> free_slots;
+
+	buffer_ring recv_buffers;
+
+	// run by the io thread on the next doorbell, see post()
+	utttil::spinlock posted_lock;
+	std::vector<std::function<void()>> posted;
+
+	// Picks the context that owns each accepted connection, this one if unset.
+	// Called on the io thread, the other context adopts the peer on its own.
+	std::function<context*(int fd)> shard;
+
+	context(const context_config & config_ = context_config())
+		: config(config_)
+		, table(new peer_entry[std::min<size_t>(config_.max_peers, entry_mask + 1)])
+		, table_capacity(std::min<size_t>(config_.max_peers, entry_mask + 1))
+		, woken(woken_bits(table_capacity))
 	{
+		for (size_t entry=table_capacity ; entry>0 ; )
+			free_entries.push_back(--entry);
+
+		if (config.defer_taskrun)
+			config.single_issuer = true;
+
 		io_uring_params params;
 		memset(&params, 0, sizeof(params));
-		//params.flags |= IORING_SETUP_SQPOLL;
-		params.sq_thread_idle = 1000;
+		if (config.sqpoll)
+		{
+			params.flags |= IORING_SETUP_SQPOLL;
+			if (config.sqpoll_cpu >= 0)
+			{
+				params.flags |= IORING_SETUP_SQ_AFF;
+				params.sq_thread_cpu = config.sqpoll_cpu;
+			}
+		}
+		params.sq_thread_idle = config.sq_thread_idle;
+		// the io thread becomes the single issuer by enabling the ring
+		if (config.single_issuer)
+			params.flags |= IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_R_DISABLED;
+		if (config.coop_taskrun)
+			params.flags |= IORING_SETUP_COOP_TASKRUN;
+		if (config.defer_taskrun)
+			params.flags |= IORING_SETUP_DEFER_TASKRUN;
+
+		int ret = io_uring_queue_init_params(config.queue_depth, &ring, &params);
+		if (ret < 0)
+			std::cerr << "io_uring_queue_init_params() " << strerror(-ret) << std::endl;
 
-		int queue_depth = 16384;
-		io_uring_queue_init_params(queue_depth, &ring, &params);
+		if (config.max_registered_peers > 0 && (config.fixed_files || config.fixed_buffers))
+		{
+			if (config.fixed_files && (ret = io_uring_register_files_sparse(&ring, config.max_registered_peers)) < 0)
+			{
+				std::cerr << "io_uring_register_files_sparse() " << strerror(-ret) << std::endl;
+				config.fixed_files = false;
+			}
+			if (config.fixed_buffers && (ret = io_uring_register_buffers_sparse(&ring, 2*config.max_registered_peers)) < 0)
+			{
+				std::cerr << "io_uring_register_buffers_sparse() " << strerror(-ret) << std::endl;
+				config.fixed_buffers = false;
+			}
+			for (int slot=config.max_registered_peers ; slot>0 ; )
+				free_slots.push_back(--slot);
+		}
+
+		if (config.multishot_recv && ! recv_buffers.setup(ring, config.recv_buffer_count, config.recv_buffer_size, 0))
+			config.multishot_recv = false;
+
+		doorbell_fd = ::eventfd(0, EFD_CLOEXEC);
+		if (doorbell_fd == -1)
+			std::cerr << "eventfd() " << strerror(errno) << std::endl;
+		arm_doorbell();
+	}
+	// a slot per peer, and as many for forgotten peers still woken once
+	static int woken_bits(size_t table_capacity)
+	{
+		int bits = 1;
+		while ((size_t(1) << bits) < 2 * table_capacity)
+			++bits;
+		return bits;
 	}
 	~context()
 	{
 		stop();
+		recv_buffers.teardown(ring);
 		io_uring_queue_exit(&ring);
+		if (doorbell_fd != -1)
+			::close(doorbell_fd);
+	}
+
+	// 0 if the table is full. From any thread, adopt() fills the entry.
+	size_t new_id()
+	{
+		std::lock_guard<utttil::spinlock> lock(table_lock);
+		if (free_entries.empty())
+			return 0;
+		std::uint32_t entry = free_entries.back();
+		free_entries.pop_back();
+		return ((size_t)table[entry].generation.load(std::memory_order_relaxed) << entry_bits) | entry;
+	}
+	void release_id(size_t id)
+	{
+		peer_entry & entry = table[id & entry_mask];
+		std::uint32_t generation = (entry.generation.load(std::memory_order_relaxed) + 1) & ((1u << generation_bits) - 1);
+		entry.generation.store(generation == 0 ? 1 : generation, std::memory_order_relaxed);
+		std::lock_guard<utttil::spinlock> lock(table_lock);
+		free_entries.push_back(id & entry_mask);
+	}
+	peer<MsgT> * find(size_t id) const
+	{
+		size_t entry = id & entry_mask;
+		if (entry >= table_capacity || table[entry].generation.load(std::memory_order_relaxed) != (id >> entry_bits))
+			return nullptr;
+		return table[entry].ptr;
+	}
+
+	// registers what config asks for, if a slot is left
+	void register_peer(peer<MsgT> & p)
+	{
+		if (free_slots.empty() || ! (config.fixed_files || config.fixed_buffers))
+			return;
+		int slot = free_slots.back();
+		free_slots.pop_back();
+		table[p.id & entry_mask].registered = slot;
+		if (config.fixed_files)
+		{
+			int ret = io_uring_register_files_update(&ring, slot, &p.fd, 1);
+			if (ret == 1)
+				p.file_index = slot;
+			else
+				std::cerr << "io_uring_register_files_update() " << strerror(-ret) << std::endl;
+		}
+		if (config.fixed_buffers)
+		{
+			iovec iov[2] = {
+				{ p.inbox .data, 2 * p.inbox .capacity() }, // both mirrored halves
+				{ p.outbox.data, 2 * p.outbox.capacity() },
+			};
+			std::uint64_t tags[2] = {0, 0};
+			int ret = io_uring_register_buffers_update_tag(&ring, 2*slot, iov, tags, 2);
+			if (ret == 2)
+			{
+				p.inbox_buf_index  = 2*slot;
+				p.outbox_buf_index = 2*slot + 1;
+			}
+			else
+				std::cerr << "io_uring_register_buffers_update_tag() " << strerror(-ret) << std::endl;
+		}
+	}
+	void unregister_peer(peer_entry & entry)
+	{
+		int slot = entry.registered;
+		if (slot < 0)
+			return;
+		entry.registered = -1;
+		if (config.fixed_files)
+		{
+			int none = -1;
+			io_uring_register_files_update(&ring, slot, &none, 1);
+		}
+		if (config.fixed_buffers)
+		{
+			iovec iov[2] = {{nullptr, 0}, {nullptr, 0}};
+			std::uint64_t tags[2] = {0, 0};
+			io_uring_register_buffers_update_tag(&ring, 2*slot, iov, tags, 2);
+		}
+		free_slots.push_back(slot);
+	}
+	// may destroy the peer
+	void forget(size_t id)
+	{
+		peer_entry & entry = table[id & entry_mask];
+		unregister_peer(entry);
+		entry.ptr = nullptr;
+		std::shared_ptr<peer<MsgT>> keep = std::move(entry.keep);
+		release_id(id);
+	}
+
+	// shutdown() completes whatever is still in flight on the socket, those
+	// completions find nothing once the peer is forgotten. A peer with
+	// zero-copy sends the kernel still holds is forgotten on the last
+	// notification instead, see handle().
+	void close_peer(peer<MsgT> * p)
+	{
+		if (p->fd != -1)
+		{
+			::shutdown(p->fd, SHUT_RDWR);
+			::close(p->fd);
+			p->fd = -1;
+		}
+		p->abandon_zc();
+		if ( ! p->zc_in_flight())
+			forget(p->id);
+	}
+
+	void adopt(std::shared_ptr<peer<MsgT>> peer_sptr)
+	{
+		peer_sptr->doorbell_fd = doorbell_fd;
+		peer_sptr->woken = &woken;
+		peer_sptr->multishot_accept = config.multishot_accept;
+		peer_sptr->zc_threshold = config.send_zc_threshold;
+		if (config.multishot_recv)
+			peer_sptr->recv_buffers = &recv_buffers;
+		peer_entry & entry = table[peer_sptr->id & entry_mask];
+		entry.ptr = peer_sptr.get();
+		entry.keep = peer_sptr;
+		register_peer(*peer_sptr);
+	}
+	void start(std::shared_ptr<peer<MsgT>> peer_sptr, bool acceptor)
+	{
+		adopt(peer_sptr);
+		if (acceptor)
+			peer_sptr->accept_loop();
+		else
+		{
+			peer_sptr->read_loop();
+			peer_sptr->write_loop();
+		}
+	}
+	// From bind(), connect() or another context's io thread: the table, the
+	// registrations and the SQ are the io thread's, which adopts the peer.
+	void start_from_outside(std::shared_ptr<peer<MsgT>> peer_sptr, bool acceptor)
+	{
+		// what the caller may touch before then
+		peer_sptr->doorbell_fd = doorbell_fd;
+		peer_sptr->woken = &woken;
+		peer_sptr->zc_threshold = config.send_zc_threshold;
+		post([this, peer_sptr, acceptor](){ start(peer_sptr, acceptor); });
+	}
+
+	// f runs on the io thread, from any thread
+	void post(std::function<void()> f)
+	{
+		{
+			std::lock_guard<utttil::spinlock> lock(posted_lock);
+			posted.push_back(std::move(f));
+		}
+		::eventfd_write(doorbell_fd, 1);
+	}
+
+	void arm_doorbell()
+	{
+		if (doorbell_fd == -1)
+			return;
+		io_uring_sqe * sqe = io_uring_get_sqe(&ring);
+		while (sqe == nullptr)
+		{
+			io_uring_submit(&ring);
+			sqe = io_uring_get_sqe(&ring);
+		}
+		io_uring_prep_read(sqe, doorbell_fd, &doorbell_value, sizeof(doorbell_value), 0);
+		io_uring_sqe_set_data(sqe, (void*)(size_t)Action::Doorbell);
+	}
+	// resumes the writers that were woken since the last ring
+	void doorbell_rung()
+	{
+		arm_doorbell();
+		std::vector<std::function<void()>> todo;
+		{
+			std::lock_guard<utttil::spinlock> lock(posted_lock);
+			std::swap(todo, posted);
+		}
+		for (auto & f : todo)
+			f();
+		while ( ! woken.empty())
+		{
+			peer<MsgT> * p = find(woken.front());
+			woken.pop_front();
+			if (p && p->write_parked && ! p->write_idle.load())
+			{
+				p->write_parked = false;
+				p->write_loop();
+			}
+		}
 	}
 
 	void run()
@@ -67,30 +384,56 @@ struct context
 			t.join();
 	}
 
-	std::shared_ptr<peer<MsgT>> bind(const utttil::url url)
+	// reuse_port: several contexts can listen on url, see cluster
+	std::shared_ptr<peer<MsgT>> bind(const utttil::url url, bool reuse_port = false)
 	{
-		std::shared_ptr<peer<MsgT>> peer_sptr = peer<MsgT>::bind(next_id++, ring, url);
-		if ( ! peer_sptr)
+		size_t id = new_id();
+		if (id == 0) {
+			std::cerr << "bind() peer table full" << std::endl;
+			return nullptr;
+		}
+		std::shared_ptr<peer<MsgT>> peer_sptr = peer<MsgT>::bind(id, ring, url, reuse_port);
+		if ( ! peer_sptr) {
+			release_id(id);
 			return nullptr;
-		peers[peer_sptr->id] = peer_sptr;
-		peer_sptr->accept_loop();
+		}
+		start_from_outside(peer_sptr, true);
 		return peer_sptr;
 	}
 
 	std::shared_ptr<peer<MsgT>> connect(const utttil::url url)
 	{
-		std::shared_ptr<peer<MsgT>> peer_sptr = peer<MsgT>::connect(next_id++, ring, url);
-		if ( ! peer_sptr)
+		size_t id = new_id();
+		if (id == 0) {
+			std::cerr << "connect() peer table full" << std::endl;
 			return nullptr;
-		peers[peer_sptr->id] = peer_sptr;
-		peer_sptr->read_loop();
-		peer_sptr->write_loop();
+		}
+		std::shared_ptr<peer<MsgT>> peer_sptr = peer<MsgT>::connect(id, ring, url);
+		if ( ! peer_sptr) {
+			release_id(id);
+			return nullptr;
+		}
+		start_from_outside(peer_sptr, false);
 		return peer_sptr;
 	}
 
+	// Everything the peers prepare while a batch of completions is handled
+	// goes to the kernel with the next wait, one io_uring_enter() per batch.
 	void loop()
 	{
-		io_uring_cqe *cqe;
+		io_uring_cqe * cqes[cqe_batch_size];
+
+		if (config.single_issuer)
+			io_uring_enable_rings(&ring);
+
+		if (config.cpu >= 0)
+		{
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(config.cpu, &cpus);
+			if (int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))
+				std::cerr << "pthread_setaffinity_np() " << strerror(ret) << std::endl;
+		}
 
 		__kernel_timespec timeout;
 		timeout.tv_sec = 0;
@@ -99,88 +442,149 @@ struct context
 		while (go_on)
 		{
 			//std::cout << "loop" << std::endl;
-			int ret = io_uring_wait_cqe_timeout(&ring, &cqe, &timeout);
-			if (ret == -ETIME) {
-				std::cout << "io_uring_wait_cqe_timeout ETIME" << std::endl;
+			io_uring_cqe * cqe;
+			int ret = io_uring_submit_and_wait_timeout(&ring, &cqe, 1, &timeout, nullptr);
+			if (ret == -ETIME)
 				continue;
-			}
 			if (ret < 0) {
-				std::cerr << "io_uring_wait_cqe_timeout failed: " << errno << " " << strerror(-ret) << std::endl;
-				continue;
-			}
-			Action action = static_cast<Action>(((ptrdiff_t)cqe->user_data) & 0x7);
-			//std::cout << "action happened: " << action << std::endl;
-			auto id = cqe->user_data >> 3;
-			//std::cout << "id: " << id << std::endl;
-			auto peer_it = peers.find(id);
-			if (peer_it == peers.end()) {
-				std::cout << "loop() peer not found with id: " << id << std::endl;
-				io_uring_cqe_seen(&ring, cqe);
+				std::cerr << "io_uring_submit_and_wait_timeout failed: " << errno << " " << strerror(-ret) << std::endl;
 				continue;
 			}
-			std::shared_ptr<peer<MsgT>> peer_sptr = peers[id].lock();
-			if ( ! peer_sptr)
+			unsigned count = io_uring_peek_batch_cqe(&ring, cqes, cqe_batch_size);
+			for (unsigned i=0 ; i<count ; i++)
+				handle(cqes[i]);
+			/* Mark these requests as processed */
+			io_uring_cq_advance(&ring, count);
+		}
+		std::cout << "loop ended" << std::endl;
+	}
+
+	void handle(io_uring_cqe * cqe)
+	{
+		Action action = static_cast<Action>(((ptrdiff_t)cqe->user_data) & 0x7);
+		//std::cout << "action happened: " << action << std::endl;
+		auto id = (cqe->user_data >> 3) & id_mask;
+		//std::cout << "id: " << id << std::endl;
+		if (id == 0 && action == Action::Doorbell)
+		{
+			if (cqe->res < 0)
+				std::cerr << "doorbell read failed: " << strerror(-cqe->res) << std::endl;
+			doorbell_rung();
+			return;
+		}
+		peer<MsgT> * p = find(id);
+		if ( ! p) // forgotten since, e.g. the cancel of a closed peer's recv
+			return;
+		bool retry = action == Action::Accept_Deferred || action == Action::Read_Deferred;
+		bool multishot = action == Action::Accept || action == Action::Recv;
+		bool expected = action == Action::None // cancels
+		             || (retry && cqe->res == -ETIME)
+		             || (multishot && cqe->res == -ECANCELED)
+		             || (action == Action::Recv && cqe->res == -ENOBUFS);
+		if (cqe->res < 0 && ! expected) {
+			std::cerr << "Async request failed: " << strerror(-cqe->res) << std::endl;
+			std::cerr << "Action was: " << action << std::endl;
+			if (action == Action::Accept)
 			{
-				std::cout << "! peer_sptr" << std::endl;
-				peers.erase(peer_it);
-				continue;
+				// e.g. EMFILE, the listener stays and tries again later
+				if ( ! (cqe->flags & IORING_CQE_F_MORE))
+					p->accept_armed = false;
+				if ( ! p->accept_paused)
+				{
+					p->accept_paused = true;
+					p->retry_later(Action::Accept_Deferred);
+				}
 			}
-			if (cqe->res < 0) {
-				std::cerr << "Async request failed: " << strerror(-cqe->res) << std::endl;
-				std::cerr << "Action was: " << action << std::endl;
-				peer_sptr->fd = -1;
-				return;
+			else // ECONNRESET, EPIPE and the like end this peer, not the loop
+			{
+				if (action == Action::Write && p->writing_zc)
+					p->zc_failed(cqe->flags & IORING_CQE_F_MORE);
+				close_peer(p);
 			}
-			//std::cout << "action: " << action << std::endl;
-			switch (action)
+			return;
+		}
+		//std::cout << "action: " << action << std::endl;
+		switch (action)
+		{
+			case Action::None:
+				break;
+			case Action::Accept:
 			{
-				case Action::None:
+				if ( ! (cqe->flags & IORING_CQE_F_MORE))
+					p->accept_armed = false;
+				if (cqe->res < 0) // cancelled, Accept_Deferred re-arms
 					break;
-				case Action::Accept:
+				int fd = cqe->res;
+				context * owner = shard ? shard(fd) : this;
+				size_t new_peer_id = owner->new_id();
+				if (new_peer_id == 0)
 				{
-					int fd = cqe->res;
-					std::shared_ptr<peer<MsgT>> new_peer_sptr = peer_sptr->accepted(next_id++, fd);
-					if ( ! new_peer_sptr)
-					{
-						::close(fd);
-						break;
-					}
-					peers[new_peer_sptr->id] = new_peer_sptr;
-					new_peer_sptr->read_loop();
-					new_peer_sptr->write_loop();
+					std::cerr << "accept: peer table full" << std::endl;
+					::close(fd);
 					break;
 				}
-				case Action::Accept_Deferred:
-					peer_sptr->accept_loop();
-					break;
-				case Action::Read:
-					//std::cout << "iou read " << cqe->res << std::endl;
-					if (cqe->res < 0) {
-						std::cout << "closing" << std::endl;
-						peer_sptr->fd = -1;
-						peers.erase(peer_it);
-					} else {
-						peer_sptr->rcvd(cqe->res);
-					}
-					break;
-				case Action::Read_Deferred:
-					peer_sptr->read_loop();
-					break;
-				case Action::Write:
-					//std::cout << "iou wrote " << cqe->res << std::endl;
-					peer_sptr->sent(cqe->res);
-					break;
-				case Action::Write_Deferred:
-					peer_sptr->write_loop();
-					break;
-				default:
-					std::cerr << "iou Invalid action " << (int)action << std::endl;
+				std::shared_ptr<peer<MsgT>> new_peer_sptr = p->accepted(new_peer_id, fd, owner->ring);
+				if (owner == this)
+					start(new_peer_sptr, false);
+				else
+					owner->start_from_outside(new_peer_sptr, false);
+				break;
+			}
+			case Action::Accept_Deferred:
+				p->accept_paused = false;
+				p->accept_loop();
+				break;
+			case Action::Read:
+				//std::cout << "iou read " << cqe->res << std::endl;
+				if (cqe->res == 0) {
+					std::cout << "closing" << std::endl;
+					close_peer(p);
+				} else {
+					p->rcvd(cqe->res);
+				}
+				break;
+			case Action::Read_Deferred:
+				p->recv_paused = false;
+				p->read_loop();
+				break;
+			case Action::Recv:
+			{
+				bool more = cqe->flags & IORING_CQE_F_MORE;
+				if ( ! more)
+					p->recv_armed = false;
+				if (cqe->res == 0) {
+					close_peer(p);
 					break;
+				}
+				if (cqe->flags & IORING_CQE_F_BUFFER)
+				{
+					unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+					p->received(recv_buffers.buffer(bid), cqe->res);
+					recv_buffers.give_back(bid);
+				}
+				else if (cqe->res == -ENOBUFS && ! p->recv_paused)
+				{
+					// all buffers are in use, give the peers time to hand some back
+					p->recv_paused = true;
+					p->retry_later(Action::Read_Deferred);
+				}
+				else if ( ! more && ! p->recv_paused)
+					p->read_loop();
+				break;
 			}
-			/* Mark this request as processed */
-			io_uring_cqe_seen(&ring, cqe);
+			case Action::Write:
+				//std::cout << "iou wrote " << cqe->res << std::endl;
+				if (cqe->flags & IORING_CQE_F_NOTIF)
+					p->zc_notified(cqe->user_data >> tag_shift);
+				else
+					p->sent(cqe->res, cqe->flags & IORING_CQE_F_MORE);
+				if (p->fd == -1) // closed, waiting for the zero-copy sends
+					close_peer(p);
+				break;
+			default:
+				std::cerr << "iou Invalid action " << (int)action << std::endl;
+				break;
 		}
-		std::cout << "loop ended" << std::endl;
 	}
 };
 
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <utttil/storage_policy.hpp>
+
+namespace utttil {
+namespace iou {
+
+// Buffers the kernel picks from for IOSQE_BUFFER_SELECT reads, shared by
+// all the peers of a context. A completion carries the id of the buffer it
+// filled, which goes back to the ring with give_back() once consumed.
+struct buffer_ring
+{
+	io_uring_buf_ring * br = nullptr;
+	char * data = nullptr;
+	unsigned entries = 0;
+	unsigned buf_size = 0;
+	int group = 0;
+	int mask = 0;
+
+	// entries must be a power of 2
+	bool setup(io_uring & ring, unsigned entries_, unsigned buf_size_, int group_)
+	{
+		data = (char*) utttil::heap_storage::allocate_bytes((size_t)entries_ * buf_size_);
+		if ( ! data)
+		{
+			std::cerr << "buffer_ring: can't allocate " << entries_ << " buffers of " << buf_size_ << " bytes" << std::endl;
+			return false;
+		}
+		int ret;
+		br = io_uring_setup_buf_ring(&ring, entries_, group_, 0, &ret);
+		if ( ! br)
+		{
+			std::cerr << "io_uring_setup_buf_ring() " << strerror(-ret) << std::endl;
+			utttil::heap_storage::deallocate_bytes(data, (size_t)entries_ * buf_size_);
+			data = nullptr;
+			return false;
+		}
+		entries = entries_;
+		buf_size = buf_size_;
+		group = group_;
+		mask = io_uring_buf_ring_mask(entries);
+		for (unsigned bid=0 ; bid<entries ; bid++)
+			io_uring_buf_ring_add(br, buffer(bid), buf_size, bid, mask, bid);
+		io_uring_buf_ring_advance(br, entries);
+		return true;
+	}
+	void teardown(io_uring & ring)
+	{
+		if ( ! br)
+			return;
+		io_uring_free_buf_ring(&ring, br, entries, group);
+		utttil::heap_storage::deallocate_bytes(data, (size_t)entries * buf_size);
+		br = nullptr;
+		data = nullptr;
+	}
+
+	char * buffer(unsigned bid) { return data + (size_t)bid * buf_size; }
+
+	void give_back(unsigned bid)
+	{
+		io_uring_buf_ring_add(br, buffer(bid), buf_size, bid, mask, 0);
+		io_uring_buf_ring_advance(br, 1);
+	}
+};
+
+}} // namespace
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+#include <utttil/iou.hpp>
+
+namespace utttil {
+namespace iou {
+
+enum class sharding
+{
+	reuse_port,  // a listener per ring, the kernel spreads connections by address hash
+	round_robin, // ring 0 accepts and deals the connections to the rings in turn
+};
+
+// N contexts, each with its own io_uring and io thread, optionally pinned.
+// A peer belongs to the ring that accepted or connected it, but any one
+// producer thread may async_write()/async_send() to it: that rings the
+// doorbell of the owning context. post() runs anything else on a ring's
+// thread.
+template<typename MsgT=no_msg_t>
+struct cluster
+{
+	std::vector<std::unique_ptr<context<MsgT>>> contexts;
+	std::atomic<size_t> next_context = 0;
+	size_t next_accepted = 0; // ring 0's io thread only
+
+	// first_cpu >= 0 pins ring i to cpu first_cpu + i, config.cpu is ignored
+	cluster(size_t count, context_config config = context_config(), int first_cpu = -1)
+	{
+		for (size_t i=0 ; i<count ; i++)
+		{
+			config.cpu = first_cpu < 0 ? -1 : first_cpu + (int)i;
+			contexts.push_back(std::make_unique<context<MsgT>>(config));
+		}
+	}
+	~cluster()
+	{
+		stop();
+	}
+
+	size_t size() const { return contexts.size(); }
+	      context<MsgT> & operator[](size_t i)       { return *contexts[i]; }
+	const context<MsgT> & operator[](size_t i) const { return *contexts[i]; }
+
+	void run()
+	{
+		for (auto & c : contexts)
+			c->run();
+	}
+	void stop()
+	{
+		for (auto & c : contexts)
+			c->stop();
+	}
+
+	context<MsgT> * next()
+	{
+		return contexts[next_context++ % contexts.size()].get();
+	}
+
+	// Accepted peers show up in the accept_inbox of the returned acceptors,
+	// one per ring with reuse_port, only ring 0's with round_robin.
+	// Empty if any bind failed.
+	std::vector<std::shared_ptr<peer<MsgT>>> bind(const utttil::url & url, sharding how = sharding::reuse_port)
+	{
+		std::vector<std::shared_ptr<peer<MsgT>>> acceptors;
+		if (how == sharding::round_robin)
+		{
+			// dealt apart from connect()'s turn, which other threads take
+			contexts[0]->shard = [this](int) { return contexts[next_accepted++ % contexts.size()].get(); };
+			if (auto acceptor = contexts[0]->bind(url))
+				acceptors.push_back(acceptor);
+			return acceptors;
+		}
+		for (auto & c : contexts)
+		{
+			auto acceptor = c->bind(url, true);
+			if ( ! acceptor)
+				return {};
+			acceptors.push_back(acceptor);
+		}
+		return acceptors;
+	}
+	// on the next ring in turn
+	std::shared_ptr<peer<MsgT>> connect(const utttil::url & url)
+	{
+		return next()->connect(url);
+	}
+
+	// f runs on ring i's io thread
+	void post(size_t i, std::function<void()> f)
+	{
+		contexts[i]->post(std::move(f));
+	}
+};
+
+}} // namespace
@@ -1,9 +1,18 @@
 
 #pragma once
 
+#include <sys/eventfd.h>
+
 #include <cassert>
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <functional>
 
 #include <utttil/perf.hpp>
+#include <utttil/mpmc_ring_buffer.hpp>
+#include <utttil/iou/buffer_ring.hpp>
 
 namespace utttil {
 namespace iou {
@@ -25,11 +34,17 @@ inline int socket()
 	return sock;
 }
 
-inline int server_socket_tcp(int port)
+// reuse_port: other sockets may listen on port, the kernel spreads connections
+inline int server_socket_tcp(int port, bool reuse_port = false)
 {
 	int sock = socket();
 	if (sock == -1)
 		return -1;
+	int enable = 1;
+	if (reuse_port && ::setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int)) < 0) {
+		std::cerr << "setsockopt(SO_REUSEPORT) " << strerror(errno) << std::endl;
+		return -1;
+	}
 
 	sockaddr_in srv_addr;
 	::memset(&srv_addr, 0, sizeof(srv_addr));
@@ -72,8 +87,13 @@ enum Action
 	Write  = 3,
 	Accept_Deferred = 4,
 	Read_Deferred   = 5,
-	Write_Deferred  = 6,
+	Doorbell        = 6, // the context's eventfd, rung when an idle writer gets data
+	Recv            = 7, // multishot, into the context's buffer_ring
 };
+// user_data is tag << tag_shift | peer id << 3 | Action. The tag numbers a
+// peer's zero-copy send requests, whose notifications come back in any order.
+inline constexpr unsigned tag_shift = 51;
+inline constexpr size_t tag_mask = (size_t(1) << (64 - tag_shift)) - 1;
 
 struct no_msg_t {};
 
@@ -89,20 +109,73 @@ struct peer
 	sockaddr_in accept_client_addr;
 	socklen_t client_addr_len = sizeof(sockaddr_in);
 	utttil::ring_buffer<std::shared_ptr<peer>> accept_inbox;
+	// A multishot accept keeps going until cancelled, which only happens once
+	// accept_inbox is full, so the few accepted meanwhile wait here.
+	bool multishot_accept = false;
+	bool accept_armed = false;
+	bool accept_paused = false;
+	std::vector<std::shared_ptr<peer>> accept_overflow;
 
 	// writer
 	inline static constexpr size_t outbox_capacity_bits = 16;
 	inline static constexpr size_t outbox_msg_capacity_bits = 10;
-	iovec write_iov[2];
-	utttil::ring_buffer<char> outbox;
+	utttil::mirrored_ring_buffer<char> outbox;
 	utttil::ring_buffer<MsgT> outbox_msg;
+	// Zero-copy sends of caller memory, see async_send_zc(). One is sent once
+	// the outbox bytes written before it are, and blocks the outbox until it
+	// is all out. Its memory is released on the kernel's last notification.
+	// Each SEND_ZC request is numbered, a notification tagged with the number
+	// is credited to the send that made the request.
+	struct zc_send
+	{
+		const char * data = nullptr;
+		size_t size = 0;
+		size_t after = 0;    // outbox_written when it was queued
+		unsigned notifs = 0; // notifications still to come
+		size_t first_request = 0; // [first_request, end_request), 0 if none yet
+		size_t end_request = 0;
+		std::function<void()> completion;
+	};
+	inline static constexpr size_t outbox_zc_capacity_bits = 8;
+	size_t zc_threshold = 16384; // smaller ones are copied to outbox
+	utttil::ring_buffer<zc_send> outbox_zc;
+	std::deque<zc_send> zc_unreleased; // io thread only
+	size_t outbox_written = 0; // by async_write(), producer only
+	size_t outbox_sent = 0;    // io thread only
+	size_t zc_offset = 0;      // of outbox_zc.front() already sent
+	bool writing_zc = false;
+	size_t zc_requests = 1;    // number of the next SEND_ZC request
+	bool zc_blocked = false;   // too many requests await notifications to tell their tags apart
 
 	// reader
 	inline static constexpr size_t inbox_capacity_bits = 16;
 	inline static constexpr size_t inbox_msg_capacity_bits = 10;
-	iovec read_iov[2];
-	utttil::ring_buffer<char> inbox;
+	utttil::mirrored_ring_buffer<char> inbox;
 	utttil::ring_buffer<MsgT> inbox_msg;
+	// Multishot recv, when the context has a buffer_ring: no read is posted
+	// per peer, data is copied into inbox as it lands in a shared buffer, and
+	// what doesn't fit waits in recv_overflow while the recv is cancelled.
+	buffer_ring * recv_buffers = nullptr;
+	bool recv_armed = false;
+	bool recv_paused = false;
+	std::vector<char> recv_overflow;
+
+	// An idle writer doesn't poll: write_loop() parks it and sets write_idle,
+	// and the first async_write()/async_send() after that queues its id in
+	// woken and rings the context's doorbell, whose completion resumes
+	// write_loop() of the peers queued.
+	int doorbell_fd = -1;
+	utttil::mpmc_ring_buffer<size_t> * woken = nullptr;
+	std::atomic<bool> write_idle = false;
+	bool write_parked = false; // io thread only
+
+	// set by the context when it registers the socket or the buffers
+	int file_index = -1;
+	int inbox_buf_index = -1;
+	int outbox_buf_index = -1;
+
+	// a full inbox or accept_inbox is retried after this long
+	__kernel_timespec retry_delay = {0, 1000000};
 
 	peer(size_t id_, int fd_, io_uring & ring_)
 		: id(id_)
@@ -111,6 +184,7 @@ struct peer
 		, accept_inbox(accept_inbox_capacity_bits)
 		, outbox      (      outbox_capacity_bits)
 		, outbox_msg  (  outbox_msg_capacity_bits)
+		, outbox_zc   (   outbox_zc_capacity_bits)
 		, inbox       (       inbox_capacity_bits)
 		, inbox_msg   (   inbox_msg_capacity_bits)
 	{}
@@ -126,11 +200,11 @@ struct peer
 		}
 		return std::make_shared<peer>(id, fd, ring);
 	}
-	static std::shared_ptr<peer> bind(size_t id, io_uring & ring, const utttil::url & url)
+	static std::shared_ptr<peer> bind(size_t id, io_uring & ring, const utttil::url & url, bool reuse_port = false)
 	{
 		int fd = -1;
 		if (url.protocol == "tcp")
-			fd = server_socket_tcp(std::stoull(url.port));
+			fd = server_socket_tcp(std::stoull(url.port), reuse_port);
 		if (fd == -1) {
 			std::cout << "bind() failed on: " << url << std::endl;
 			return nullptr;
@@ -138,39 +212,77 @@ struct peer
 		return std::make_shared<peer>(id, fd, ring);
 	}
 
-	void signal(Action action)
+	// SQEs are only prepared here, context::loop() submits all those of a
+	// batch of completions at once. A full submission queue is flushed early.
+	io_uring_sqe * get_sqe()
 	{
 		io_uring_sqe * sqe = io_uring_get_sqe(&ring);
-		while(sqe == nullptr)
+		while (sqe == nullptr)
 		{
-			_mm_pause();
+			io_uring_submit(&ring);
 			sqe = io_uring_get_sqe(&ring);
 		}
-		io_uring_prep_nop(sqe);
+		return sqe;
+	}
+
+	// fd for an SQE, the registered slot if any
+	int io_fd() const { return file_index >= 0 ? file_index : fd; }
+	void set_fixed_file(io_uring_sqe * sqe) const
+	{
+		if (file_index >= 0)
+			io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+	}
+
+	// comes back as action after retry_delay
+	void retry_later(Action action)
+	{
+		io_uring_sqe * sqe = get_sqe();
+		io_uring_prep_timeout(sqe, &retry_delay, 0, 0);
 		size_t user_data = (id << 3) | action;
 		io_uring_sqe_set_data(sqe, (void*)user_data);
-		io_uring_submit(&ring);
+	}
+
+	// the request completes with -ECANCELED, the cancel itself as Action::None
+	void cancel(Action action)
+	{
+		io_uring_sqe * sqe = get_sqe();
+		io_uring_prep_cancel64(sqe, (id << 3) | action, 0);
+		size_t user_data = (id << 3) | Action::None;
+		io_uring_sqe_set_data(sqe, (void*)user_data);
 	}
 
 	void accept_loop()
 	{
 		if (fd == -1)
 			return;
+		size_t moved = 0;
+		while (moved < accept_overflow.size() && ! accept_inbox.full())
+			accept_inbox.push_back(std::move(accept_overflow[moved++]));
+		accept_overflow.erase(accept_overflow.begin(), accept_overflow.begin() + moved);
 		if (accept_inbox.full())
 		{
+			if (accept_paused)
+				return;
+			accept_paused = true;
+			if (accept_armed)
+				cancel(Action::Accept);
 			//std::cout << "send Action::Accept_Deferred" << std::endl;
-			return signal(Action::Accept_Deferred);
+			return retry_later(Action::Accept_Deferred);
 		}
-		io_uring_sqe * sqe = io_uring_get_sqe(&ring);
-		while(sqe == nullptr)
+		accept_paused = false;
+		if (accept_armed)
+			return;
+		io_uring_sqe * sqe = get_sqe();
+		if (multishot_accept)
 		{
-			_mm_pause();
-			sqe = io_uring_get_sqe(&ring);
+			io_uring_prep_multishot_accept(sqe, io_fd(), (sockaddr*) &accept_client_addr, &client_addr_len, 0);
+			accept_armed = true;
 		}
-		io_uring_prep_accept(sqe, fd, (sockaddr*) &accept_client_addr, &client_addr_len, 0);
+		else
+			io_uring_prep_accept(sqe, io_fd(), (sockaddr*) &accept_client_addr, &client_addr_len, 0);
+		set_fixed_file(sqe);
 		size_t user_data = (id << 3) | Action::Accept;
 		io_uring_sqe_set_data(sqe, (void*)user_data);
-		io_uring_submit(&ring);
 		return;
 	}
 	void write_loop()
@@ -180,25 +292,50 @@ struct peer
 			std::cout << __func__ << " stopped fd == -1" << std::endl;
 			return;
 		}
-		if (outbox.empty()) {
+		if (outbox.empty())
+			pack();
+		if (outbox.empty() && outbox_zc.empty())
+		{
+			write_parked = true;
+			write_idle.store(true);
+			std::atomic_thread_fence(std::memory_order_seq_cst); // see wake_writer()
 			pack();
-			//std::cout << __func__ << " deferred outbox empty" << std::endl;
-			return signal(Action::Write_Deferred);
+			if ((outbox.empty() && outbox_zc.empty()) || ! write_idle.exchange(false))
+				return; // idle, or already woken and the doorbell will resume us
+			write_parked = false;
 		}
-		std::tie(write_iov[0].iov_base, write_iov[0].iov_len) = outbox.front_stretch();
-		std::tie(write_iov[1].iov_base, write_iov[1].iov_len) = outbox.front_stretch_2();
-		//std::cout << "sending write signal for " << write_iov[0].iov_len << std::endl;
-
-		struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
-		while(sqe == nullptr)
+		zc_send * zc = outbox_zc.try_front();
+		if (zc && outbox_sent >= zc->after)
 		{
-			_mm_pause();
-			sqe = io_uring_get_sqe(&ring);
+			if (zc_requests - oldest_zc_request() > tag_mask)
+			{
+				zc_blocked = true; // zc_notified() resumes
+				return;
+			}
+			if (zc->end_request == 0)
+				zc->first_request = zc_requests;
+			zc->end_request = zc_requests + 1;
+			io_uring_sqe * sqe = get_sqe();
+			io_uring_prep_send_zc(sqe, io_fd(), zc->data + zc_offset, zc->size - zc_offset, 0, 0);
+			set_fixed_file(sqe);
+			size_t user_data = ((zc_requests++ & tag_mask) << tag_shift) | (id << 3) | Action::Write;
+			io_uring_sqe_set_data(sqe, (void*)user_data);
+			writing_zc = true;
+			return;
 		}
-		io_uring_prep_writev(sqe, fd, &write_iov[0], 1 + (write_iov[1].iov_len > 0), 0);
+		auto [write_ptr, write_size] = outbox.front_stretch();
+		if (zc)
+			write_size = std::min(write_size, zc->after - outbox_sent);
+		//std::cout << "sending write signal for " << write_size << std::endl;
+
+		io_uring_sqe * sqe = get_sqe();
+		if (outbox_buf_index >= 0)
+			io_uring_prep_write_fixed(sqe, io_fd(), write_ptr, write_size, 0, outbox_buf_index);
+		else
+			io_uring_prep_write(sqe, io_fd(), write_ptr, write_size, 0);
+		set_fixed_file(sqe);
 		size_t user_data = (id << 3) | Action::Write;
 		io_uring_sqe_set_data(sqe, (void*)user_data);
-		io_uring_submit(&ring);
 
 		pack();
 	}
@@ -207,43 +344,193 @@ struct peer
 		//std::cout << __func__ << std::endl;
 		if (fd == -1)
 			return;
+		if (recv_buffers)
+			return recv_loop();
 		if (inbox.full())
 		{
 			unpack();
 			//std::cout << "send Action::Read_Deferred" << std::endl;
-			return signal(Action::Read_Deferred);
+			return retry_later(Action::Read_Deferred);
 		}
-		std::tie(read_iov[0].iov_base, read_iov[0].iov_len) = inbox.back_stretch();
-		std::tie(read_iov[1].iov_base, read_iov[1].iov_len) = inbox.back_stretch_2();
-		io_uring_sqe * sqe = io_uring_get_sqe(&ring);
-		while(sqe == nullptr)
-		{
-			_mm_pause();
-			sqe = io_uring_get_sqe(&ring);
-		}
-		io_uring_prep_readv(sqe, fd, &read_iov[0], 1 + (read_iov[1].iov_len > 0), 0);
+		auto [read_ptr, read_size] = inbox.back_stretch();
+		io_uring_sqe * sqe = get_sqe();
+		if (inbox_buf_index >= 0)
+			io_uring_prep_read_fixed(sqe, io_fd(), read_ptr, read_size, 0, inbox_buf_index);
+		else
+			io_uring_prep_read(sqe, io_fd(), read_ptr, read_size, 0);
+		set_fixed_file(sqe);
 		size_t user_data = (id << 3) | Action::Read;
 		io_uring_sqe_set_data(sqe, (void*)user_data);
-		io_uring_submit(&ring);
 
 		unpack();
 	}
 
-	std::shared_ptr<peer> accepted(size_t id, int fd)
+	void recv_loop()
+	{
+		drain_recv_overflow();
+		if ( ! recv_overflow.empty())
+		{
+			if (recv_paused)
+				return;
+			recv_paused = true;
+			if (recv_armed)
+				cancel(Action::Recv);
+			return retry_later(Action::Read_Deferred);
+		}
+		recv_paused = false;
+		if (recv_armed)
+			return;
+		io_uring_sqe * sqe = get_sqe();
+		io_uring_prep_recv_multishot(sqe, io_fd(), nullptr, 0, 0);
+		set_fixed_file(sqe);
+		sqe->flags |= IOSQE_BUFFER_SELECT;
+		sqe->buf_group = recv_buffers->group;
+		size_t user_data = (id << 3) | Action::Recv;
+		io_uring_sqe_set_data(sqe, (void*)user_data);
+		recv_armed = true;
+	}
+	size_t push_inbox(const char * data, size_t size)
+	{
+		auto [inbox_ptr, inbox_size] = inbox.back_stretch();
+		size_t count = std::min(size, inbox_size);
+		memcpy(inbox_ptr, data, count);
+		inbox.advance_back(count);
+		return count;
+	}
+	void drain_recv_overflow()
+	{
+		while ( ! recv_overflow.empty())
+		{
+			unpack();
+			size_t count = push_inbox(recv_overflow.data(), recv_overflow.size());
+			if (count == 0)
+				break;
+			recv_overflow.erase(recv_overflow.begin(), recv_overflow.begin() + count);
+		}
+		unpack();
+	}
+	// from a recv buffer, which goes back to the ring right after
+	void received(const char * data, size_t size)
+	{
+		size_t count = recv_overflow.empty() ? push_inbox(data, size) : 0;
+		unpack();
+		if (count < size)
+			recv_overflow.insert(recv_overflow.end(), data + count, data + size);
+		recv_loop();
+	}
+
+	// called by producers after they add to outbox or outbox_msg
+	void wake_writer()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst); // the push is visible before we look at write_idle
+		if (write_idle.load(std::memory_order_relaxed) && write_idle.exchange(false))
+		{
+			woken->push_back(id);
+			::eventfd_write(doorbell_fd, 1);
+		}
+	}
+
+	// the new peer is driven by new_ring, that of the context that owns it
+	std::shared_ptr<peer> accepted(size_t id, int fd, io_uring & new_ring)
 	{
-		auto new_peer_sptr = std::make_shared<peer>(id, fd, ring);;
-		accept_inbox.push_back(new_peer_sptr);
+		auto new_peer_sptr = std::make_shared<peer>(id, fd, new_ring);
+		if (accept_inbox.full())
+			accept_overflow.push_back(new_peer_sptr);
+		else
+			accept_inbox.push_back(new_peer_sptr);
 		accept_loop();
 		return new_peer_sptr;
 	}
-	void sent(size_t count)
+	// more: a zero-copy send will get a notification
+	void sent(size_t count, bool more = false)
 	{
 		//std::cout << __func__ << count << std::endl;
 		//std::cout << "sent() outbox size: " << outbox.size() << std::endl;
+		if (writing_zc)
+		{
+			writing_zc = false;
+			zc_send & zc = outbox_zc.front();
+			if (more)
+				zc.notifs++;
+			zc_offset += count;
+			if (zc_offset == zc.size)
+			{
+				zc_offset = 0;
+				zc_unreleased.push_back(std::move(zc));
+				outbox_zc.pop_front();
+				release_zc();
+			}
+			return write_loop();
+		}
 		assert(count <= outbox.size());
 		outbox.advance_front(count);
+		outbox_sent += count;
 		write_loop();
 	}
+	// a SEND_ZC request that failed, the socket is being closed
+	void zc_failed(bool more)
+	{
+		writing_zc = false;
+		if (more)
+			outbox_zc.front().notifs++;
+	}
+	size_t oldest_zc_request()
+	{
+		if ( ! zc_unreleased.empty())
+			return zc_unreleased.front().first_request;
+		zc_send * zc = outbox_zc.try_front();
+		return zc && zc->end_request != 0 ? zc->first_request : zc_requests;
+	}
+	// the kernel is done with the memory of the request tagged tag
+	void zc_notified(size_t tag)
+	{
+		// at most tag_mask requests are outstanding, see write_loop()
+		size_t oldest = oldest_zc_request();
+		size_t request = oldest + ((tag - oldest) & tag_mask);
+		auto made = [request](const zc_send & zc) { return zc.first_request <= request && request < zc.end_request; };
+		auto it = std::find_if(zc_unreleased.begin(), zc_unreleased.end(), made);
+		if (it != zc_unreleased.end())
+			it->notifs--;
+		else
+		{
+			assert( ! outbox_zc.empty() && made(outbox_zc.front()) && outbox_zc.front().notifs > 0);
+			outbox_zc.front().notifs--;
+		}
+		release_zc();
+		if (zc_blocked)
+		{
+			zc_blocked = false;
+			write_loop();
+		}
+	}
+	// Once the socket is closed: what the kernel never got is released now,
+	// the rest as its notifications come. The peer stays until then.
+	void abandon_zc()
+	{
+		if ( ! writing_zc)
+		{
+			while ( ! outbox_zc.empty())
+			{
+				zc_unreleased.push_back(std::move(outbox_zc.front()));
+				outbox_zc.pop_front();
+			}
+			zc_offset = 0;
+		}
+		release_zc();
+	}
+	bool zc_in_flight() const
+	{
+		return writing_zc || ! zc_unreleased.empty();
+	}
+	void release_zc()
+	{
+		while ( ! zc_unreleased.empty() && zc_unreleased.front().notifs == 0)
+		{
+			if (zc_unreleased.front().completion)
+				zc_unreleased.front().completion();
+			zc_unreleased.pop_front();
+		}
+	}
 	void rcvd(size_t count)
 	{
 		//std::cout << __func__ << count << std::endl;
@@ -254,9 +541,9 @@ struct peer
 
 	void pack()
 	{
-		while ( ! outbox_msg.empty())
+		while (MsgT * msg_ptr = outbox_msg.try_front())
 		{
-			MsgT & msg = outbox_msg.front();
+			MsgT & msg = *msg_ptr;
 
 			auto size_preview_serializer = utttil::srlz::to_binary(utttil::srlz::device::null_writer());
 			size_preview_serializer << msg;
@@ -268,9 +555,7 @@ struct peer
 				return;
 			}
 			try {
-				auto stretch1 = outbox.back_stretch();
-				auto stretch2 = outbox.back_stretch_2();
-				auto s = utttil::srlz::to_binary(utttil::srlz::device::ring_buffer_writer(stretch1, stretch2, total_size));
+				auto s = utttil::srlz::to_binary(utttil::srlz::device::ptr_writer(std::get<0>(outbox.back_stretch())));
 				s << msg_size;
 				s << msg;
 				outbox.advance_back(s.write.size());
@@ -285,7 +570,8 @@ struct peer
 	{
 		while ( ! inbox_msg.full())
 		{
-			auto deserializer = utttil::srlz::from_binary(utttil::srlz::device::ring_buffer_reader(inbox, inbox.size()));
+			auto [inbox_ptr, inbox_size] = inbox.front_stretch();
+			auto deserializer = utttil::srlz::from_binary(utttil::srlz::device::ptr_reader(inbox_ptr, inbox_size));
 			size_t msg_size;
 			size_t total_size;
 			try {
@@ -294,7 +580,7 @@ struct peer
 				break;
 			}
 			total_size = msg_size + deserializer.read.size();
-			if (total_size > inbox.size()) {
+			if (total_size > inbox_size) {
 				break;
 			}
 			MsgT & msg = inbox_msg.back();
@@ -325,19 +611,49 @@ struct peer
 			size_t len_to_write = std::min(len, std::get<1>(stretch));
 			memcpy(std::get<0>(stretch), data, len_to_write);
 			outbox.advance_back(len_to_write);
+			outbox_written += len_to_write;
+			wake_writer();
 
 			data += len_to_write;
 			len  -= len_to_write;
 		}
 		//std::cout << "async_write: " << data.size() << std::endl;
 	}
+	// Sends [data, data+len) from the caller's memory, which must stay as is
+	// until completion runs, on the io thread. Under zc_threshold it is copied
+	// like async_write() and completion runs right away. A peer closed since
+	// still runs completion, once the kernel is done with the memory.
+	// Ordered with async_write() only: async_send() messages are packed on
+	// the io thread's schedule, so don't mix the two on one peer.
+	void async_send_zc(const char * data, size_t len, std::function<void()> completion)
+	{
+		if (len < zc_threshold || fd == -1) // closed: never handed to the kernel
+		{
+			if (fd != -1)
+				async_write(data, len);
+			if (completion)
+				completion();
+			return;
+		}
+		zc_send & zc = outbox_zc.back();
+		zc.data = data;
+		zc.size = len;
+		zc.after = outbox_written;
+		zc.notifs = 0;
+		zc.completion = std::move(completion);
+		outbox_zc.advance_back();
+		wake_writer();
+	}
+
 	void async_send(const MsgT & msg)
 	{
 		outbox_msg.push_back(msg);
+		wake_writer();
 	}
 	void async_send(MsgT && msg)
 	{
 		outbox_msg.push_back(std::move(msg));
+		wake_writer();
 	}
 
 };
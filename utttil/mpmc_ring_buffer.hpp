@@ -0,0 +1,249 @@
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <immintrin.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace utttil {
+
+// Bounded multiple-producer multiple-consumer ring (Vyukov).
+// Each slot carries a sequence number: seq == pos means the slot is free for
+// the producer claiming position pos, seq == pos+1 means it holds the element
+// at pos. Producers and consumers only contend on the index they CAS.
+//
+// push_back()/emplace_back() and pop_front(T&) are safe for any number of
+// threads, elements must be nothrow move assignable. For zero copy, a producer fills the slot of a claim_back() in place
+// then hands the claim to publish(); a claim that is never published stalls
+// the consumers at its slot. The zero-copy back()/advance_back() and
+// front()/pop_front() pairs work in place like ring_buffer's and assume a
+// single producer, respectively a single consumer, which is the fan-in case.
+template<typename T>
+struct mpmc_ring_buffer
+{
+	using value_type = T;
+	inline static constexpr size_t cache_line_size = 64;
+
+	struct slot
+	{
+		std::atomic<size_t> seq;
+		T value;
+	};
+
+	size_t Capacity;
+	size_t Mask;
+	slot * data;
+
+	// consumers
+	alignas(cache_line_size) std::atomic<size_t> front_;
+
+	// producers
+	alignas(cache_line_size) std::atomic<size_t> back_;
+
+	mpmc_ring_buffer(int size_in_bits)
+		: Capacity(1 << size_in_bits)
+		, Mask(Capacity - 1)
+		, data(new slot[Capacity])
+		, front_(0)
+		, back_(0)
+	{
+		for (size_t i=0 ; i<Capacity ; i++)
+			data[i].seq.store(i, std::memory_order_relaxed);
+	}
+	~mpmc_ring_buffer()
+	{
+		delete[] data;
+	}
+
+	size_t capacity() const
+	{
+		return Capacity;
+	}
+	// approximate while producers or consumers are active
+	size_t size() const
+	{
+		size_t f = front_.load(std::memory_order_acquire);
+		size_t b =  back_.load(std::memory_order_acquire);
+		return b > f ? b - f : 0;
+	}
+	size_t free_size() const
+	{
+		return capacity() - size();
+	}
+	bool empty() const
+	{
+		size_t f = front_.load(std::memory_order_relaxed);
+		return data[f & Mask].seq.load(std::memory_order_acquire) != f+1;
+	}
+	bool full() const
+	{
+		size_t b = back_.load(std::memory_order_relaxed);
+		return data[b & Mask].seq.load(std::memory_order_acquire) != b;
+	}
+	bool contains(const slot * s) const
+	{
+		return s >= data && s < data + Capacity;
+	}
+
+	// producer side
+
+	// a slot owned by the producer that claimed it, until publish()
+	struct claim
+	{
+		slot * s;
+		T & operator* () const { return  s->value; }
+		T * operator->() const { return &s->value; }
+	};
+
+	slot & claim_slot()
+	{
+		size_t b = back_.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			slot & s = data[b & Mask];
+			std::intptr_t diff = (std::intptr_t)s.seq.load(std::memory_order_acquire) - (std::intptr_t)b;
+			if (diff == 0)
+			{
+				// on failure b is reloaded
+				if (back_.compare_exchange_weak(b, b+1, std::memory_order_relaxed))
+					return s;
+			}
+			else
+			{
+				if (diff < 0) // full
+					_mm_pause();
+				b = back_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+	static void publish(slot & s)
+	{
+		// nobody else touches seq between claim and publish
+		s.seq.store(s.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+	claim claim_back()
+	{
+		return claim{&claim_slot()};
+	}
+	void publish(claim c)
+	{
+		assert(contains(c.s));
+		publish(*c.s);
+	}
+
+	// single producer
+	T & back()
+	{
+		size_t b = back_.load(std::memory_order_relaxed);
+		slot & s = data[b & Mask];
+		while (s.seq.load(std::memory_order_acquire) != b)
+			_mm_pause();
+		return s.value;
+	}
+	// single producer
+	void advance_back()
+	{
+		size_t b = back_.load(std::memory_order_relaxed);
+		slot & s = data[b & Mask];
+		while (s.seq.load(std::memory_order_acquire) != b)
+			_mm_pause();
+		back_.store(b+1, std::memory_order_relaxed);
+		s.seq.store(b+1, std::memory_order_release);
+	}
+
+	// Nothing is returned: once published, a slot can be consumed and reused
+	// by another producer before the caller would look at it.
+	// Whatever may throw runs before claiming, so that it doesn't leave a
+	// claimed slot behind, never published.
+	void push_back(T && t)
+	{
+		static_assert(std::is_nothrow_move_assignable<T>::value, "mpmc_ring_buffer moves into claimed slots, which must not throw");
+		slot & s = claim_slot();
+		s.value = std::move(t);
+		publish(s);
+	}
+	void push_back(const T & t)
+	{
+		if constexpr (std::is_nothrow_copy_assignable<T>::value)
+		{
+			slot & s = claim_slot();
+			s.value = t;
+			publish(s);
+		}
+		else
+			push_back(T(t));
+	}
+	template<typename ...P>
+	void emplace_back(P&&... params)
+	{
+		if constexpr (std::is_nothrow_constructible<T, P&&...>::value)
+		{
+			slot & s = claim_slot();
+			s.value.~T();
+			new (&s.value) T(std::forward<P>(params)...);
+			publish(s);
+		}
+		else
+			push_back(T(std::forward<P>(params)...));
+	}
+
+	// consumer side
+
+	// single consumer
+	T & front()
+	{
+		size_t f = front_.load(std::memory_order_relaxed);
+		slot & s = data[f & Mask];
+		while (s.seq.load(std::memory_order_acquire) != f+1)
+			_mm_pause();
+		return s.value;
+	}
+	// single consumer
+	void pop_front()
+	{
+		size_t f = front_.load(std::memory_order_relaxed);
+		slot & s = data[f & Mask];
+		while (s.seq.load(std::memory_order_acquire) != f+1)
+			_mm_pause();
+		front_.store(f+1, std::memory_order_relaxed);
+		s.seq.store(f + Capacity, std::memory_order_release);
+	}
+	// any number of consumers
+	void pop_front(T & out)
+	{
+		size_t f = front_.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			slot & s = data[f & Mask];
+			std::intptr_t diff = (std::intptr_t)s.seq.load(std::memory_order_acquire) - (std::intptr_t)(f+1);
+			if (diff == 0)
+			{
+				// on failure f is reloaded
+				if (front_.compare_exchange_weak(f, f+1, std::memory_order_relaxed))
+				{
+					out = std::move(s.value);
+					s.seq.store(f + Capacity, std::memory_order_release);
+					return;
+				}
+			}
+			else
+			{
+				if (diff < 0) // empty
+					_mm_pause();
+				f = front_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+};
+
+template<typename Out, typename T>
+Out & operator<<(Out & out, const utttil::mpmc_ring_buffer<T> & rb)
+{
+	return out << "mpmc_ring_buffer sizeof(T): " << sizeof(T) << ", capacity: " << rb.capacity() << ", front_: " << rb.front_.load() << ", back: " << rb.back_.load();
+}
+
+} // namespace
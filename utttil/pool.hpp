@@ -1,15 +1,93 @@
 
 #pragma once
 
+#include <cassert>
 #include <memory>
 #include <type_traits>
 #include <limits>
 #include <exception>
+#include <stdexcept>
 #include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include <cstring>
+
+#include <utttil/storage_policy.hpp>
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define UTTTIL_ASAN 1
+#endif
+#elif defined(__SANITIZE_ADDRESS__)
+#define UTTTIL_ASAN 1
+#endif
+#ifdef UTTTIL_ASAN
+#include <sanitizer/asan_interface.h>
+#endif
 
 namespace utttil {
 
-template<typename T, typename Index=std::uint32_t>
+// Tells ASan that a region must not be touched until unpoisoned, no-ops
+// without ASan.
+inline void asan_poison(const volatile void * p, size_t size)
+{
+#ifdef UTTTIL_ASAN
+	ASAN_POISON_MEMORY_REGION(p, size);
+#else
+	(void) p; (void) size;
+#endif
+}
+inline void asan_unpoison(const volatile void * p, size_t size)
+{
+#ifdef UTTTIL_ASAN
+	ASAN_UNPOISON_MEMORY_REGION(p, size);
+#else
+	(void) p; (void) size;
+#endif
+}
+
+// Reuse policies of fixed_pool.
+// lifo_reuse hands out the cell freed last, still hot in cache.
+// fifo_reuse hands out the cell that has been free the longest, which
+// quarantines freed cells for as long as possible so that a use after free
+// hits a dead, poisoned cell rather than a live object.
+struct lifo_reuse { inline static constexpr bool fifo = false; };
+struct fifo_reuse { inline static constexpr bool fifo = true; };
+
+#ifdef NDEBUG
+inline constexpr bool pool_poison_default = false;
+#else
+inline constexpr bool pool_poison_default = true;
+#endif
+inline constexpr unsigned char pool_poison_byte = 0xdd;
+
+struct pool_stats
+{
+	size_t live = 0;
+	size_t peak = 0;
+	size_t allocs = 0;
+	size_t frees = 0;
+	size_t failed_allocs = 0; // alloc() on a full pool
+};
+
+template<typename Out>
+Out & operator<<(Out & out, const pool_stats & s)
+{
+	return out << "live: " << s.live << ", peak: " << s.peak << ", allocs: " << s.allocs
+	           << ", frees: " << s.frees << ", failed_allocs: " << s.failed_allocs;
+}
+
+// Free cells make a list threaded through the cells themselves, and a bitmap
+// of the constructed ones lets for_each() and serialize() skip 64 free cells
+// at a time in a single pass.
+// Storage provides the cells: heap_storage (malloc) or mmap_storage (huge
+// pages, NUMA node, prefaulting).
+// Reuse is lifo_reuse (default) or fifo_reuse. With Poison, on by default
+// in debug builds, free cells are filled with pool_poison_byte and, under
+// ASan, poisoned but for their free list link.
+template<typename T, typename Index=std::uint32_t, typename Storage=heap_storage, typename Reuse=lifo_reuse, bool Poison=pool_poison_default>
 struct fixed_pool
 {
 	using index_t = Index;
@@ -22,21 +100,29 @@ struct fixed_pool
 
 	Obj * collection;
 	index_t first_free;
+	index_t last_free; // fifo_reuse only
 	index_t size_;
 	index_t capacity_;
+	std::vector<std::uint64_t> occupied; // bit per cell, set while constructed
+	size_t peak_ = 0;
+	size_t allocs_ = 0;
+	size_t failed_allocs_ = 0;
 
 	explicit fixed_pool()
 		: collection(nullptr)
 		, first_free(0)
+		, last_free(0)
 		, size_(0)
 		, capacity_(0)
 	{}
 
 	fixed_pool(size_t capacity)
-		: collection((Obj*)malloc(sizeof(Obj) * capacity))
+		: collection((Obj*)Storage::allocate_bytes(sizeof(Obj) * capacity))
 		, first_free(0)
+		, last_free(capacity-1)
 		, size_(0)
 		, capacity_(capacity)
+		, occupied((capacity + 63) / 64, 0)
 	{
 		if ( ! collection)
 			throw std::bad_alloc();
@@ -44,11 +130,45 @@ struct fixed_pool
 			throw std::invalid_argument("pool dynamic size too big for static index type");
 		for (index_t i=0 ; i<capacity-1 ; ++i)
 			collection[i].next_index = i+1;
+		if constexpr (Poison)
+			for (index_t i=0 ; i<capacity_ ; ++i)
+				poison(i);
 	}
 	~fixed_pool()
 	{
 		for_each([](T & t){ t.~T(); });
-		::free(collection);
+		release_storage();
+	}
+	void release_storage()
+	{
+		if constexpr (Poison)
+			asan_unpoison(collection, sizeof(Obj) * capacity_);
+		Storage::deallocate_bytes(collection, sizeof(Obj) * capacity_);
+	}
+
+	void poison(index_t idx)
+	{
+		Obj & cell = collection[idx];
+		Index next = cell.next_index;
+		std::memset((void*)&cell, pool_poison_byte, sizeof(Obj));
+		cell.next_index = next;
+		asan_poison(&cell, sizeof(Obj));
+		asan_unpoison(&cell.next_index, sizeof(Index));
+	}
+	void unpoison(index_t idx)
+	{
+		asan_unpoison(&collection[idx], sizeof(Obj));
+	}
+
+	pool_stats stats() const
+	{
+		pool_stats s;
+		s.live = size_;
+		s.peak = peak_;
+		s.allocs = allocs_;
+		s.frees = allocs_ - size_;
+		s.failed_allocs = failed_allocs_;
+		return s;
 	}
 
 	size_t size() const { return size_; }
@@ -56,16 +176,28 @@ struct fixed_pool
 	bool empty() const { return size_ == 0; }
 	bool full() const { return size_ == capacity_; }
 
+	bool is_constructed(index_t idx) const { return (occupied[idx / 64] >> (idx % 64)) & 1; }
+
 	template<typename...Args>
 	T * alloc(Args...args)
 	{
 		if (full())
+		{
+			++failed_allocs_;
 			return nullptr;
+		}
 
-		T * result = &collection[first_free].t;
-		first_free = collection[first_free].next_index;
+		index_t idx = first_free;
+		T * result = &collection[idx].t;
+		first_free = collection[idx].next_index;
 		++size_;
+		++allocs_;
+		if (size_ > peak_)
+			peak_ = size_;
+		occupied[idx / 64] |= std::uint64_t(1) << (idx % 64);
 
+		if constexpr (Poison)
+			unpoison(idx);
 		new (result) T(args...);
 		return result;
 	}
@@ -73,11 +205,26 @@ struct fixed_pool
 	void free(T * ptr)
 	{
 		index_t idx = index_of(ptr);
+		assert(is_constructed(idx) && "double free or not from this pool");
 
 		ptr->~T();
-		collection[idx].next_index = first_free;
-		first_free = idx;
+		occupied[idx / 64] &= ~(std::uint64_t(1) << (idx % 64));
+		if constexpr (Reuse::fifo)
+		{
+			if (full()) // the free list is empty
+				first_free = idx;
+			else
+				collection[last_free].next_index = idx;
+			last_free = idx;
+		}
+		else
+		{
+			collection[idx].next_index = first_free;
+			first_free = idx;
+		}
 		--size_;
+		if constexpr (Poison)
+			poison(idx);
 	}
 
 	bool contains(T * ptr)
@@ -95,112 +242,353 @@ struct fixed_pool
 		return collection[idx].t;
 	}
 
+	// f(idx) for each constructed cell, in index order
+	template<typename F>
+	void for_each_index(F f) const
+	{
+		for (size_t w=0 ; w<occupied.size() ; w++)
+			for (std::uint64_t bits = occupied[w] ; bits != 0 ; bits &= bits - 1)
+				f(index_t(w * 64 + __builtin_ctzll(bits)));
+	}
 	template<typename F>
 	void for_each(F f)
 	{
-		std::vector<bool> constructed(capacity(), true);
-		size_t free_cells = capacity() - size();
-		for ( index_t idx = first_free
-			; free_cells-- != 0
-			; idx = collection[idx].next_index)
-		{
-			constructed[idx] = false;
-		}
-		for ( index_t idx = 0
-			; idx < capacity()
-			; idx++ )
-		{
-			if (constructed[idx])
-				f(collection[idx].t);
-		}
+		for_each_index([&](index_t idx){ f(collection[idx].t); });
 	}
-	
+	template<typename F>
+	void for_each(F f) const
+	{
+		for_each_index([&](index_t idx){ f((const T &) collection[idx].t); });
+	}
+
+	// capacity, size, then index and value of each constructed cell
 	template<typename Serializer>
 	void serialize(Serializer && s) const
 	{
-		std::vector<index_t> free_cells_idx;
-		free_cells_idx.reserve(capacity()-size());
-		index_t i = first_free;
-		for (size_t s=size() ; s>0 ; s--)
-			free_cells_idx.push_back(i);
-		std::sort(free_cells_idx.begin(), free_cells_idx.end());
-
-		s << capacity()
-		  << size();
-		for (i=0 ; i<size() ; i++)
-			if (std::find(free_cells_idx.begin(), free_cells_idx.end(), i) == free_cells_idx.end())
-				s << i
-				  << collection[i].t;
+		s << capacity_
+		  << size_;
+		for_each_index([&](index_t idx)
+			{
+				s << idx
+				  << collection[idx].t;
+			});
 	}
 	template<typename Deserializer>
 	void deserialize(Deserializer && s)
 	{
-		if (collection != nullptr)
-		{
-			this->~fixed_pool();
-		}
+		for_each([](T & t){ t.~T(); });
+		release_storage();
+		collection = nullptr;
+
 		s >> capacity_
 		  >> size_;
-		collection = (Obj*)malloc(sizeof(Obj) * capacity_);
-		std::vector<index_t> used_cells_idx;
-		used_cells_idx.reserve(size_);
+		collection = (Obj*)Storage::allocate_bytes(sizeof(Obj) * capacity_);
+		if ( ! collection && capacity_ != 0)
+			throw std::bad_alloc();
+		occupied.assign((capacity_ + 63) / 64, 0);
 		for (size_t i=0 ; i<size_ ; i++)
 		{
 			index_t idx;
 			s >> idx;
+			new (&collection[idx].t) T();
 			s >> collection[idx].t;
-			used_cells_idx.push_back(idx);
+			occupied[idx / 64] |= std::uint64_t(1) << (idx % 64);
 		}
+		// rebuild the free list in index order, so that allocations go up
+		first_free = capacity_;
+		last_free = capacity_;
 		for (index_t idx=capacity_ ; idx>0 ; )
 		{
 			idx--;
-			if (std::find(used_cells_idx.begin(), used_cells_idx.end(), idx) == used_cells_idx.end())
+			if ( ! is_constructed(idx))
 			{
 				collection[idx].next_index = first_free;
+				if (first_free == capacity_)
+					last_free = idx;
 				first_free = idx;
+				if constexpr (Poison)
+					poison(idx);
 			}
 		}
+		peak_ = size_;
+		allocs_ = size_;
+		failed_allocs_ = 0;
+	}
+};
+
+// Grows by chaining slabs of slab_size objects, never moves anything.
+// A handle is slab index * slab_size + slot, stable for the object's life.
+// Freed cells from all slabs share one free list, never-used cells of the
+// last slab are handed out in order, so alloc() is O(1) besides the slab
+// allocation itself.
+template<typename T>
+struct segmented_pool
+{
+	using handle_t = std::uint64_t;
+	inline static constexpr handle_t no_handle = std::numeric_limits<handle_t>::max();
+
+	union Obj
+	{
+		T t;
+		handle_t next_handle;
+	};
+
+	size_t slab_bits;
+	size_t slab_mask;
+	std::vector<Obj*> slabs;
+	std::vector<std::pair<Obj*,size_t>> slabs_by_address; // sorted, for handle_of()
+	std::vector<std::uint64_t> occupied; // bit per handle, set while constructed
+	handle_t first_free;
+	handle_t first_unused;
+	size_t size_;
+
+	// slab_size is rounded up to a power of 2
+	segmented_pool(size_t slab_size)
+		: slab_bits(0)
+		, first_free(no_handle)
+		, first_unused(0)
+		, size_(0)
+	{
+		while ((size_t(1) << slab_bits) < slab_size)
+			++slab_bits;
+		slab_mask = (size_t(1) << slab_bits) - 1;
+	}
+	segmented_pool(const segmented_pool &) = delete;
+	~segmented_pool()
+	{
+		for_each([](T & t){ t.~T(); });
+		for (Obj * slab : slabs)
+			::free(slab);
+	}
+
+	size_t size() const { return size_; }
+	size_t capacity() const { return slabs.size() << slab_bits; }
+	size_t slab_size() const { return slab_mask + 1; }
+	bool empty() const { return size_ == 0; }
+
+	Obj & cell(handle_t h) { return slabs[h >> slab_bits][h & slab_mask]; }
+	const Obj & cell(handle_t h) const { return slabs[h >> slab_bits][h & slab_mask]; }
+
+	void add_slab()
+	{
+		Obj * slab = (Obj*)malloc(sizeof(Obj) << slab_bits);
+		if ( ! slab)
+			throw std::bad_alloc();
+		slabs.push_back(slab);
+		auto it = std::lower_bound(slabs_by_address.begin(), slabs_by_address.end(), std::make_pair(slab, size_t(0)));
+		slabs_by_address.insert(it, std::make_pair(slab, slabs.size()-1));
+		occupied.resize((capacity() + 63) / 64, 0);
+	}
+	bool is_constructed(handle_t h) const { return (occupied[h / 64] >> (h % 64)) & 1; }
+
+	template<typename...Args>
+	T * alloc(Args...args)
+	{
+		return &element_at(alloc_handle(args...));
+	}
+	template<typename...Args>
+	handle_t alloc_handle(Args...args)
+	{
+		handle_t h;
+		if (first_free != no_handle)
+		{
+			h = first_free;
+			first_free = cell(h).next_handle;
+		}
+		else
+		{
+			if (first_unused == capacity())
+				add_slab();
+			h = first_unused++;
+		}
+		new (&cell(h).t) T(args...);
+		occupied[h / 64] |= std::uint64_t(1) << (h % 64);
+		++size_;
+		return h;
+	}
+
+	void free(T * ptr)
+	{
+		free_handle(handle_of(ptr));
+	}
+	void free_handle(handle_t h)
+	{
+		cell(h).t.~T();
+		occupied[h / 64] &= ~(std::uint64_t(1) << (h % 64));
+		cell(h).next_handle = first_free;
+		first_free = h;
+		--size_;
+	}
+
+	bool contains(const T * ptr) const
+	{
+		return handle_of(ptr) != no_handle;
+	}
+	// O(log(slab count))
+	handle_t handle_of(const T * ptr) const
+	{
+		const Obj * obj = (const Obj*) ptr;
+		auto it = std::upper_bound(slabs_by_address.begin(), slabs_by_address.end(), obj
+			, [](const Obj * o, const std::pair<Obj*,size_t> & slab) { return o < slab.first; });
+		if (it == slabs_by_address.begin())
+			return no_handle;
+		--it;
+		size_t slot = obj - it->first;
+		if (slot > slab_mask)
+			return no_handle;
+		return (it->second << slab_bits) + slot;
+	}
+	handle_t handle_of(const T & t) const { return handle_of(&t); }
+	const T & element_at(handle_t h) const { return cell(h).t; }
+	      T & element_at(handle_t h)       { return cell(h).t; }
+
+	template<typename F>
+	void for_each(F f)
+	{
+		for (size_t w=0 ; w<occupied.size() ; w++)
+			for (std::uint64_t bits = occupied[w] ; bits != 0 ; bits &= bits - 1)
+				f(cell(w * 64 + __builtin_ctzll(bits)).t);
+	}
+};
+
+// smallest unsigned type that holds N
+template<size_t N>
+using index_for = std::conditional_t<N <= std::numeric_limits<std::uint8_t >::max(), std::uint8_t,
+                  std::conditional_t<N <= std::numeric_limits<std::uint16_t>::max(), std::uint16_t,
+                  std::conditional_t<N <= std::numeric_limits<std::uint32_t>::max(), std::uint32_t,
+                                                                                     std::uint64_t>>>;
+
+// Typed index into a pool of T, as small as the pool's index type, for
+// intrusive links. Dereferenced through the pool: pool[h].
+template<typename T, typename Index>
+struct handle
+{
+	using index_t = Index;
+	inline static constexpr Index null_index = std::numeric_limits<Index>::max();
+
+	Index index = null_index;
+
+	static handle null() { return handle(); }
+	bool is_null() const { return index == null_index; }
+	explicit operator bool() const { return ! is_null(); }
+	bool operator==(const handle & other) const { return index == other.index; }
+	bool operator!=(const handle & other) const { return index != other.index; }
+};
+
+// fixed_pool with a compile-time capacity: the cells live in the pool
+// object itself and indices and handles use the smallest type that fits N.
+// Large ones belong in static storage or on the heap, not on the stack.
+template<typename T, size_t N>
+struct static_pool
+{
+	using index_t = index_for<N>;
+	using handle_t = utttil::handle<T,index_t>;
+	inline static constexpr index_t no_index = handle_t::null_index;
+
+	union Obj
+	{
+		T t;
+		index_t next_index;
+		Obj() {}
+		~Obj() {}
+	};
+
+	Obj collection[N];
+	std::uint64_t occupied[(N + 63) / 64] = {};
+	index_t first_free;
+	index_t size_;
+
+	static_pool()
+		: first_free(N == 0 ? no_index : 0)
+		, size_(0)
+	{
+		for (size_t i=0 ; i<N ; ++i)
+			collection[i].next_index = i+1 == N ? no_index : i+1;
+	}
+	static_pool(const static_pool &) = delete;
+	~static_pool()
+	{
+		for_each([](T & t){ t.~T(); });
+	}
+
+	static constexpr size_t capacity() { return N; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+	bool full() const { return size_ == N; }
+
+	bool is_constructed(index_t idx) const { return (occupied[idx / 64] >> (idx % 64)) & 1; }
+
+	template<typename...Args>
+	handle_t alloc_handle(Args...args)
+	{
+		if (full())
+			return handle_t::null();
+		index_t idx = first_free;
+		first_free = collection[idx].next_index;
+		++size_;
+		occupied[idx / 64] |= std::uint64_t(1) << (idx % 64);
+		new (&collection[idx].t) T(args...);
+		return handle_t{idx};
+	}
+	template<typename...Args>
+	T * alloc(Args...args)
+	{
+		handle_t h = alloc_handle(args...);
+		return h ? &collection[h.index].t : nullptr;
+	}
+
+	void free_handle(handle_t h)
+	{
+		index_t idx = h.index;
+		collection[idx].t.~T();
+		occupied[idx / 64] &= ~(std::uint64_t(1) << (idx % 64));
+		collection[idx].next_index = first_free;
+		first_free = idx;
+		--size_;
+	}
+	void free(T * ptr)
+	{
+		free_handle(handle_of(ptr));
+	}
+
+	bool contains(const T * ptr) const
+	{
+		const Obj * obj = (const Obj*) ptr;
+		return ! std::less<const Obj*>()(obj, collection) && std::less<const Obj*>()(obj, collection + N);
+	}
+	index_t index_of(const T * ptr) const { return ((const Obj*) ptr) - &collection[0]; }
+	handle_t handle_of(const T * ptr) const { return handle_t{index_of(ptr)}; }
+	const T & element_at(index_t idx) const { return collection[idx].t; }
+	      T & element_at(index_t idx)       { return collection[idx].t; }
+	const T & operator[](handle_t h) const { return collection[h.index].t; }
+	      T & operator[](handle_t h)       { return collection[h.index].t; }
+
+	template<typename F>
+	void for_each(F f)
+	{
+		for (size_t w=0 ; w<(N + 63) / 64 ; w++)
+			for (std::uint64_t bits = occupied[w] ; bits != 0 ; bits &= bits - 1)
+				f(collection[w * 64 + __builtin_ctzll(bits)].t);
 	}
 };
 
 template<typename T> using fixed_pool_tiny  = fixed_pool<T,std::uint8_t>;
 template<typename T> using fixed_pool_large = fixed_pool<T,std::uint64_t>;
 
-template<typename T, typename Index>
-bool operator==(const fixed_pool<T,Index> & left, const fixed_pool<T,Index> & right)
+// same capacity, same constructed cells holding equal values
+template<typename T, typename Index, typename Storage, typename Reuse, bool Poison>
+bool operator==(const fixed_pool<T,Index,Storage,Reuse,Poison> & left, const fixed_pool<T,Index,Storage,Reuse,Poison> & right)
 {
-	// test the basics
 	if (left.size() != right.size() || left.capacity() != right.capacity())
 		return false;
-
-	// find free cells on left
-	std::vector<Index> left_free_cells_idx;
-	left_free_cells_idx.reserve(left.capacity()-left.size());
-	auto i = left.first_free;
-	for (size_t s=left.size() ; s>0 ; s--)
-		left_free_cells_idx.push_back(i);
-	std::sort(left_free_cells_idx.begin(), left_free_cells_idx.end());
-
-	// find free cells on right
-	std::vector<Index> right_free_cells_idx;
-	right_free_cells_idx.reserve(right.capacity()-right.size());
-	i = right.first_free;
-	for (size_t s=right.size() ; s>0 ; s--)
-		right_free_cells_idx.push_back(i);
-	std::sort(right_free_cells_idx.begin(), right_free_cells_idx.end());
-
-	// compare free cells
-	for (size_t idx=0 ; idx<left_free_cells_idx.size() ; idx++)
-		if (left_free_cells_idx[idx] != right_free_cells_idx[idx])
-			return false;
-
-	// compare used cells
-	for (size_t idx=0 ; idx<left.capacity() ; idx++)
-		if (std::find(left_free_cells_idx.begin(), left_free_cells_idx.end(), i) == left_free_cells_idx.end())
-			if (left.element_at(idx) != right.element_at(idx))
-				return false;
-
-	return true;
+	if (left.occupied != right.occupied)
+		return false;
+	bool equal = true;
+	left.for_each_index([&](Index idx)
+		{
+			equal = equal && left.element_at(idx) == right.element_at(idx);
+		});
+	return equal;
 }
 
 } // namespace
@@ -1,43 +1,87 @@
-
 #pragma once
 
 #include <cassert>
 #include <immintrin.h>
 #include <atomic>
 #include <memory>
+#include <algorithm>
+#include <type_traits>
+
+#include <utttil/wait_policy.hpp>
+#include <utttil/storage_policy.hpp>
+#include <utttil/ring_stats.hpp>
 
 namespace utttil {
 
-template<typename T>
+// Single-producer single-consumer ring.
+// front_ is owned by the consumer, back_ by the producer. Each side keeps a
+// cached copy of the other side's index on its own cache line and only
+// reloads the shared one when the cached view says empty/full.
+// Wait decides how blocking accessors wait: spin_wait (default) or park_wait.
+// Storage allocates the elements: heap_storage (default), mmap_storage (huge
+// pages, NUMA node, prefaulting) or mirrored_storage, with which stretches
+// never wrap and the *_stretch_2() are always empty.
+// Stats is no_ring_stats (default, compiles away) or ring_stats, see stats().
+template<typename T, typename Wait=spin_wait, typename Storage=heap_storage, typename Stats=no_ring_stats>
 struct ring_buffer
 {
 	using value_type = T;
+	inline static constexpr size_t cache_line_size = 64;
+
 	size_t Capacity;
 	size_t Mask;
-
 	T * data;
-	size_t front_;
-	size_t back_;
+	bool owns_data; // false for storage handed to the constructor
+
+	// consumer
+	alignas(cache_line_size) std::atomic<size_t> front_;
+	mutable size_t cached_back_;
+	mutable typename Wait::state front_waiters_; // producer waiting for front_ to move
+	mutable typename Stats::consumer consumer_stats_;
+
+	// producer
+	alignas(cache_line_size) std::atomic<size_t> back_;
+	mutable size_t cached_front_;
+	mutable typename Wait::state back_waiters_; // consumer waiting for back_ to move
+	mutable typename Stats::producer producer_stats_;
 
 	ring_buffer(int size_in_bits)
 		: Capacity(1 << size_in_bits)
 		, Mask(Capacity - 1)
-		, data(new T[Capacity])
+		, data(Storage::template allocate<T>(Capacity))
+		, owns_data(true)
+		, front_(0)
+		, cached_back_(0)
+		, back_(0)
+		, cached_front_(0)
+	{}
+	// uses data as is, e.g. in a shared mapping, and leaves it to its owner
+	ring_buffer(int size_in_bits, T * data_)
+		: Capacity(1 << size_in_bits)
+		, Mask(Capacity - 1)
+		, data(data_)
+		, owns_data(false)
 		, front_(0)
+		, cached_back_(0)
 		, back_(0)
+		, cached_front_(0)
 	{}
 	ring_buffer(ring_buffer && other)
 		: Capacity(other.Capacity)
 		, Mask    (other.Mask    )
 		, data    (nullptr)
-		, front_  (other.front_)
-		, back_   (other.back_ )
+		, owns_data(other.owns_data)
+		, front_  (other.front_.load())
+		, cached_back_ (other.cached_back_ )
+		, back_   (other.back_ .load())
+		, cached_front_(other.cached_front_)
 	{
 		std::swap(data, other.data);
 	}
 	~ring_buffer()
 	{
-		delete[] data;
+		if (owns_data)
+			Storage::deallocate(data, Capacity);
 	}
 
 	using difference_type = std::int64_t;
@@ -59,39 +103,27 @@ struct ring_buffer
 		iterator operator+(size_t s) const { return iterator{rb, pos+s}; }
 		int operator-(const iterator & other) const { return other.pos - pos; }
 	};
-	iterator begin() { return iterator{this, front_}; }
-	iterator   end() { return iterator{this,  back_}; }
-
-	void erase(iterator it, const iterator & end_)
-	{
-		//std::cout << "ring_buffer sizeof(T) " << sizeof(T) << ", erase" << std::endl;
-		if (it != begin())
-			throw std::exception();
-		for ( ; it!=end_ ; ++it)
-		{
-			if (it == end())
-				throw std::exception();
-			pop_front();
-		}
-	}
+	iterator begin() { return iterator{this, front_.load(std::memory_order_acquire)}; }
+	iterator   end() { return iterator{this,  back_.load(std::memory_order_acquire)}; }
 
-	/*
-	void resize(int size_in_bits)
+	// only from the front
+	void erase(const iterator & it, const iterator & end_)
 	{
-		Capacity = 1 << size_in_bits;
-		Mask = Capacity - 1;
-		T * new_data = realloc(data.get(), sizeof(
-		data(std::make_unique<T[]>(new T[Capacity]()))
+		assert(it.pos == front_.load(std::memory_order_relaxed));
+		assert(end_.pos - it.pos <= size());
+		advance_front(end_.pos - it.pos);
 	}
-	*/
 
 	void clear()
 	{
-		front_ = back_;
+		cached_back_ = back_.load(std::memory_order_acquire);
+		publish_front(cached_back_);
 	}
 	void reset()
 	{
-		front_ = back_ = 0;
+		front_.store(0, std::memory_order_relaxed);
+		back_ .store(0, std::memory_order_relaxed);
+		cached_back_ = cached_front_ = 0;
 	}
 
 	size_t capacity() const
@@ -100,7 +132,9 @@ struct ring_buffer
 	}
 	size_t size() const
 	{
-		return back_-front_;
+		// front_ first: both only grow, so the difference can't go negative
+		size_t f = front_.load(std::memory_order_acquire);
+		return back_.load(std::memory_order_acquire) - f;
 	}
 	size_t free_size() const
 	{
@@ -108,207 +142,390 @@ struct ring_buffer
 	}
 	bool empty() const
 	{
-		return front_ == back_;
+		return size() == 0;
 	}
 	bool full() const
 	{
 		return size() == capacity();
 	}
 
+	// consumer side
+	bool empty_cached() const
+	{
+		size_t f = front_.load(std::memory_order_relaxed);
+		if (f < cached_back_)
+			return false;
+		cached_back_ = back_.load(std::memory_order_acquire);
+		return f >= cached_back_;
+	}
+	// producer side
+	bool full_cached() const
+	{
+		size_t b = back_.load(std::memory_order_relaxed);
+		if (b - cached_front_ < Capacity)
+			return false;
+		cached_front_ = front_.load(std::memory_order_acquire);
+		return b - cached_front_ >= Capacity;
+	}
+
+	void wait_not_empty() const
+	{
+		if (empty_cached())
+			Wait::wait(back_, back_waiters_, [this](){ consumer_stats_.on_spin(); return empty_cached(); });
+	}
+	void wait_not_full() const
+	{
+		if (full_cached())
+			Wait::wait(front_, front_waiters_, [this](){ producer_stats_.on_spin(); return full_cached(); });
+	}
+	void publish_front(size_t f)
+	{
+		front_.store(f, std::memory_order_release);
+		Wait::notify(front_, front_waiters_);
+	}
+	void publish_back(size_t b)
+	{
+		back_.store(b, std::memory_order_release);
+		Wait::notify(back_, back_waiters_);
+		if constexpr (Stats::enabled)
+			if (producer_stats_.sample())
+			{
+				cached_front_ = front_.load(std::memory_order_acquire);
+				producer_stats_.on_push(b - cached_front_);
+			}
+	}
+
+	ring_stats_snapshot stats() const
+	{
+		ring_stats_snapshot s;
+		s.pops   = front_.load(std::memory_order_relaxed);
+		s.pushes =  back_.load(std::memory_order_relaxed);
+		producer_stats_.fill(s);
+		consumer_stats_.fill(s);
+		return s;
+	}
+
 	T & front()
 	{
-		while (empty())
-			_mm_pause();
-		return data[front_ & Mask];
+		wait_not_empty();
+		return data[front_.load(std::memory_order_relaxed) & Mask];
 	}
 	T & back()
 	{
-		while (full())
-			_mm_pause();
-		T & r = data[back_ & Mask];
+		wait_not_full();
+		T & r = data[back_.load(std::memory_order_relaxed) & Mask];
 		_m_prefetchw(&r);
 		return r;
 	}
 	const T & front() const
 	{
-		while (empty())
-			_mm_pause();
-		return data[front_ & Mask];
+		wait_not_empty();
+		return data[front_.load(std::memory_order_relaxed) & Mask];
 	}
 	const T & back() const
 	{
-		while (full())
-			_mm_pause();
-		return data[back_ & Mask];
+		wait_not_full();
+		return data[back_.load(std::memory_order_relaxed) & Mask];
 	}
 
 	void pop_front(size_t n)
 	{
+		size_t f = front_.load(std::memory_order_relaxed);
 		while (n>0)
 		{
-			while (empty())
-				_mm_pause();
-			size_t s = std::min(size(), n);
-			front_ += s;
+			wait_not_empty();
+			size_t s = std::min(cached_back_ - f, n);
+			f += s;
+			publish_front(f);
 			n -= s;
 		}
 	}
 	void pop_front()
 	{
-		while (empty())
-			_mm_pause();
-		++front_;
+		wait_not_empty();
+		publish_front(front_.load(std::memory_order_relaxed) + 1);
 	}
 
 	std::tuple<T*,size_t> back_stretch()
 	{
+		size_t b = back_.load(std::memory_order_relaxed);
+		size_t f = cached_front_ = front_.load(std::memory_order_acquire);
+		if constexpr (Storage::mirrored)
+			return std::make_tuple(&data[b & Mask], capacity() - (b - f));
 		// TODO: branchless
-		if (back_ == front_+capacity())
+		if (b == f+capacity())
 			return std::make_tuple(
-					&data[back_ & Mask],
+					&data[b & Mask],
 					0
 				);
-		if ((back_ & Mask) >= (front_ & Mask)) {
-			assert(capacity() - (back_ & Mask) <= free_size());
+		if ((b & Mask) >= (f & Mask)) {
+			assert(capacity() - (b & Mask) <= (capacity() - (b - f)));
 			return std::make_tuple(
-					&data[back_ & Mask],
-					capacity() - (back_ & Mask)
+					&data[b & Mask],
+					capacity() - (b & Mask)
 				);
 		} else {
-			assert((front_ & Mask) - (back_ & Mask) <= free_size());
+			assert((f & Mask) - (b & Mask) <= (capacity() - (b - f)));
 			return std::make_tuple(
-					&data[back_ & Mask],
-					(front_ & Mask) - (back_ & Mask)
+					&data[b & Mask],
+					(f & Mask) - (b & Mask)
 				);
 		}
 	}
 	std::tuple<T*,size_t> back_stretch_2()
 	{
+		size_t b = back_.load(std::memory_order_relaxed);
+		size_t f = cached_front_; // as refreshed by back_stretch(), so both agree
+		if constexpr (Storage::mirrored)
+			return std::make_tuple(&data[f & Mask], 0);
 		// TODO: branchless
-		if (back_ == front_+capacity())
+		if (b == f+capacity())
 			return std::make_tuple(
-					&data[front_ & Mask],
+					&data[f & Mask],
 					0
 				);
-		if ((back_ & Mask) >= (front_ & Mask)) {
-			assert((front_ & Mask) <= free_size());
+		if ((b & Mask) >= (f & Mask)) {
+			assert((f & Mask) <= (capacity() - (b - f)));
 			return std::make_tuple(
 					data,
-					front_ & Mask
+					f & Mask
 				);
 		} else {
 			return std::make_tuple(
-					&data[front_ & Mask],
+					&data[f & Mask],
 					0
 				);
 		}
 	}
 	std::tuple<T*,size_t> front_stretch()
 	{
+		size_t f = front_.load(std::memory_order_relaxed);
+		size_t b = cached_back_ = back_.load(std::memory_order_acquire);
+		if constexpr (Storage::mirrored)
+			return std::make_tuple(&data[f & Mask], b - f);
 		// TODO: branchless
-		if (back_ == front_) 
+		if (b == f) 
 			return std::make_tuple(
-					&data[front_ & Mask],
+					&data[f & Mask],
 					0
 				);
-		if ((back_ & Mask) > (front_ & Mask)) {
-			assert(back_ - front_ <= capacity());
+		if ((b & Mask) > (f & Mask)) {
+			assert(b - f <= capacity());
 			return std::make_tuple(
-					&data[front_ & Mask],
-					back_ - front_
+					&data[f & Mask],
+					b - f
 				);
 		} else {
-			assert(capacity() - (front_ & Mask) <= size());
+			assert(capacity() - (f & Mask) <= (b - f));
 			return std::make_tuple(
-					&data[front_ & Mask],
-					capacity() - (front_ & Mask)
+					&data[f & Mask],
+					capacity() - (f & Mask)
 				);
 		}
 	}
 	std::tuple<T*,size_t> front_stretch_2()
 	{
+		size_t f = front_.load(std::memory_order_relaxed);
+		size_t b = cached_back_; // as refreshed by front_stretch(), so both agree
+		if constexpr (Storage::mirrored)
+			return std::make_tuple(&data[b & Mask], 0);
 		// TODO: branchless
-		if (back_ == front_) 
+		if (b == f) 
 			return std::make_tuple(
-					&data[back_ & Mask],
+					&data[b & Mask],
 					0
 				);
-		if ((back_ & Mask) > (front_ & Mask)) {
+		if ((b & Mask) > (f & Mask)) {
 			return std::make_tuple(
-					&data[back_ & Mask],
+					&data[b & Mask],
 					0
 				);
 		} else {
-			assert((back_ & Mask) < size());
+			assert((b & Mask) < (b - f));
 			return std::make_tuple(
 					data,
-					back_ & Mask
+					b & Mask
 				);
 		}
 	}
 	void advance_back(size_t n)
 	{
 		assert(n <= free_size());
-		back_ += n;
+		publish_back(back_.load(std::memory_order_relaxed) + n);
 	}
 	void advance_back()
 	{
 		assert(1 <= free_size());
-		back_ ++;
+		publish_back(back_.load(std::memory_order_relaxed) + 1);
 	}
 	void advance_front(size_t n)
 	{
 		assert(n <= size());
-		front_ += n;
+		publish_front(front_.load(std::memory_order_relaxed) + n);
 	}
 
 	void prefetch_back(size_t forward_count=1)
 	{
-		_m_prefetchw(&data[(back_+forward_count) & Mask]);
+		_m_prefetchw(&data[(back_.load(std::memory_order_relaxed)+forward_count) & Mask]);
 	}
 
 	T & push_back()
 	{
-		while (full())
-			_mm_pause();
-		T & result = data[back_ & Mask];
-		++back_;
+		wait_not_full();
+		size_t b = back_.load(std::memory_order_relaxed);
+		T & result = data[b & Mask];
+		publish_back(b+1);
 		return result;
 	}
 	T & push_back(T && t)
 	{
-		while (full())
-			_mm_pause();
-		data[back_ & Mask] = std::forward<T>(t);
-		T & result = data[back_ & Mask];
-		++back_;
+		wait_not_full();
+		size_t b = back_.load(std::memory_order_relaxed);
+		T & result = data[b & Mask];
+		result = std::forward<T>(t);
+		publish_back(b+1);
 		return result;
 	}
 	T & push_back(const T & t)
 	{
-		while (full())
-			_mm_pause();
-		data[back_ & Mask] = t;
-		T & result = data[back_ & Mask];
-		++back_;
+		wait_not_full();
+		size_t b = back_.load(std::memory_order_relaxed);
+		T & result = data[b & Mask];
+		result = t;
+		publish_back(b+1);
 		return result;
 	}
+	// copies n elements, publishing each contiguous batch with one index store
+	void push_back_n(const T * src, size_t n)
+	{
+		while (n > 0)
+		{
+			wait_not_full();
+			size_t b = back_.load(std::memory_order_relaxed);
+			if (Capacity - (b - cached_front_) < n)
+				cached_front_ = front_.load(std::memory_order_acquire);
+			size_t count = std::min(n, Capacity - (b - cached_front_));
+			size_t first = Storage::mirrored ? count : std::min(count, Capacity - (b & Mask));
+			std::copy(src      , src+first, &data[b & Mask]);
+			std::copy(src+first, src+count, data);
+			publish_back(b+count);
+			src += count;
+			n   -= count;
+		}
+	}
+	// moves n elements out, releasing each contiguous batch with one index store
+	void pop_front_n(T * dst, size_t n)
+	{
+		while (n > 0)
+		{
+			wait_not_empty();
+			size_t f = front_.load(std::memory_order_relaxed);
+			if (cached_back_ - f < n)
+				cached_back_ = back_.load(std::memory_order_acquire);
+			size_t count = std::min(n, cached_back_ - f);
+			size_t first = Storage::mirrored ? count : std::min(count, Capacity - (f & Mask));
+			dst = std::move(&data[f & Mask], &data[(f & Mask) + first], dst);
+			dst = std::move(data, data + (count-first), dst);
+			publish_front(f+count);
+			n -= count;
+		}
+	}
+	// calls visitor(T&) on everything available right now, then releases it
+	// all with one index store. Doesn't wait. Returns the number visited.
+	template<typename F>
+	size_t consume_available(F && visitor)
+	{
+		auto [ptr_1, size_1] = front_stretch();
+		auto [ptr_2, size_2] = front_stretch_2();
+		for (T * end=ptr_1+size_1 ; ptr_1<end ; ++ptr_1)
+			visitor(*ptr_1);
+		for (T * end=ptr_2+size_2 ; ptr_2<end ; ++ptr_2)
+			visitor(*ptr_2);
+		advance_front(size_1 + size_2);
+		return size_1 + size_2;
+	}
+
+	// slots always hold live objects, so building in place means destroying
+	// the previous one first. That's only safe if building can't throw.
 	template<typename ...P>
-	T & emplace_back(P... params)
+	static void construct(T & slot, P&&... params)
 	{
-		while (full())
-			_mm_pause();
-		data[back_ & Mask] = T(params...);
-		T & result = data[back_ & Mask];
-		++back_;
+		if constexpr (std::is_nothrow_constructible<T, P&&...>::value)
+		{
+			slot.~T();
+			new (&slot) T(std::forward<P>(params)...);
+		}
+		else
+			slot = T(std::forward<P>(params)...);
+	}
+
+	template<typename ...P>
+	T & emplace_back(P&&... params)
+	{
+		wait_not_full();
+		size_t b = back_.load(std::memory_order_relaxed);
+		T & result = data[b & Mask];
+		construct(result, std::forward<P>(params)...);
+		publish_back(b+1);
 		return result;
 	}
+
+	// try_* return right away, false or nullptr meaning full/empty
+	bool try_push(const T & t)
+	{
+		if (full_cached())
+			return false;
+		size_t b = back_.load(std::memory_order_relaxed);
+		data[b & Mask] = t;
+		publish_back(b+1);
+		return true;
+	}
+	bool try_push(T && t)
+	{
+		if (full_cached())
+			return false;
+		size_t b = back_.load(std::memory_order_relaxed);
+		data[b & Mask] = std::forward<T>(t);
+		publish_back(b+1);
+		return true;
+	}
+	template<typename ...P>
+	bool try_emplace(P&&... params)
+	{
+		if (full_cached())
+			return false;
+		size_t b = back_.load(std::memory_order_relaxed);
+		construct(data[b & Mask], std::forward<P>(params)...);
+		publish_back(b+1);
+		return true;
+	}
+	bool try_pop(T & out)
+	{
+		if (empty_cached())
+			return false;
+		size_t f = front_.load(std::memory_order_relaxed);
+		out = std::move(data[f & Mask]);
+		publish_front(f+1);
+		return true;
+	}
+	T * try_front()
+	{
+		if (empty_cached())
+			return nullptr;
+		return &data[front_.load(std::memory_order_relaxed) & Mask];
+	}
 };
 
-template<typename Out, typename T>
-Out & operator<<(Out & out, const utttil::ring_buffer<T> & rb)
+template<typename T, typename Wait=spin_wait, typename Stats=no_ring_stats>
+using mirrored_ring_buffer = ring_buffer<T, Wait, mirrored_storage, Stats>;
+
+template<typename Out, typename T, typename Wait, typename Storage, typename Stats>
+Out & operator<<(Out & out, const utttil::ring_buffer<T,Wait,Storage,Stats> & rb)
 {
-	return out << "ring_buffer sizeof(T): " << sizeof(T) << ", capacity: " << rb.capacity() << ", front_: " << rb.front_ << ", back: " << rb.back_;
+	out << "ring_buffer sizeof(T): " << sizeof(T) << ", capacity: " << rb.capacity() << ", front_: " << rb.front_.load() << ", back: " << rb.back_.load();
+	if constexpr (Stats::enabled)
+		out << ", " << rb.stats();
+	return out;
 }
 
 } // namespace
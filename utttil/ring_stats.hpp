@@ -0,0 +1,121 @@
+
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+
+namespace utttil {
+
+// Stats policies for ring_buffer. Counters are written by one side only, so
+// they are bumped with a relaxed load + store rather than a locked add, and
+// can be read from any thread through a ring_stats_snapshot.
+// pushes/pops aren't counted, they are the ring's indices.
+// Occupancy is sampled once every SamplePeriod pushes: only then does the
+// producer read the consumer's index, and bump the histogram and high-water
+// mark. Peaks between two samples are missed.
+
+struct ring_stats_snapshot
+{
+	size_t pushes = 0;
+	size_t pops = 0;
+	size_t high_water_mark = 0;
+	size_t full_spins = 0;  // wait iterations of the producer on a full ring
+	size_t empty_spins = 0; // wait iterations of the consumer on an empty ring
+	std::array<size_t,65> occupancy_log2 = {}; // [i] counts sampled pushes that left 2^(i-1) <= size < 2^i
+};
+
+template<typename Out>
+Out & operator<<(Out & out, const ring_stats_snapshot & s)
+{
+	out << "pushes: " << s.pushes << ", pops: " << s.pops << ", high_water_mark: " << s.high_water_mark
+	    << ", full_spins: " << s.full_spins << ", empty_spins: " << s.empty_spins << ", occupancy_log2: {";
+	const char * sep = "";
+	for (size_t i=0 ; i<s.occupancy_log2.size() ; i++)
+		if (s.occupancy_log2[i] != 0)
+		{
+			out << sep << i << ": " << s.occupancy_log2[i];
+			sep = ", ";
+		}
+	return out << "}";
+}
+
+// Compiles away.
+struct no_ring_stats
+{
+	inline static constexpr bool enabled = false;
+
+	struct producer
+	{
+		bool sample() { return false; }
+		void on_push(size_t) {}
+		void on_spin() {}
+		void fill(ring_stats_snapshot &) const {}
+	};
+	struct consumer
+	{
+		void on_spin() {}
+		void fill(ring_stats_snapshot &) const {}
+	};
+};
+
+template<size_t SamplePeriod>
+struct basic_ring_stats
+{
+	inline static constexpr bool enabled = true;
+	inline static constexpr size_t sample_period = SamplePeriod;
+
+	static inline void bump(std::atomic<size_t> & counter)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	struct producer
+	{
+		std::atomic<size_t> high_water = 0;
+		std::atomic<size_t> spins = 0;
+		std::array<std::atomic<size_t>,65> occupancy_log2 = {};
+		size_t countdown = SamplePeriod; // producer only
+
+		bool sample()
+		{
+			if (--countdown != 0)
+				return false;
+			countdown = SamplePeriod;
+			return true;
+		}
+		void on_push(size_t occupancy)
+		{
+			bump(occupancy_log2[occupancy == 0 ? 0 : 64 - __builtin_clzll(occupancy)]);
+			if (occupancy > high_water.load(std::memory_order_relaxed))
+				high_water.store(occupancy, std::memory_order_relaxed);
+		}
+		void on_spin()
+		{
+			bump(spins);
+		}
+		void fill(ring_stats_snapshot & s) const
+		{
+			s.high_water_mark = high_water.load(std::memory_order_relaxed);
+			s.full_spins = spins.load(std::memory_order_relaxed);
+			for (size_t i=0 ; i<occupancy_log2.size() ; i++)
+				s.occupancy_log2[i] = occupancy_log2[i].load(std::memory_order_relaxed);
+		}
+	};
+	struct consumer
+	{
+		std::atomic<size_t> spins = 0;
+
+		void on_spin()
+		{
+			bump(spins);
+		}
+		void fill(ring_stats_snapshot & s) const
+		{
+			s.empty_spins = spins.load(std::memory_order_relaxed);
+		}
+	};
+};
+using ring_stats = basic_ring_stats<64>;
+
+} // namespace
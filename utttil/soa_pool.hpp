@@ -0,0 +1,163 @@
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <utttil/storage_policy.hpp>
+
+namespace utttil {
+
+// Pool of objects split in one array per field, all indexed by the same
+// slot, so that a scan touching a few fields only loads those.
+// Fields are constructed in alloc() and destroyed in free(). Dead slots of
+// trivially destructible fields keep whatever they last held: dense loops
+// over column<I>() should mask with is_live() / occupied, or go through
+// for_each_index().
+template<typename Storage, typename...Fields>
+struct basic_soa_pool
+{
+	using index_t = std::uint32_t;
+	using fields_t = std::tuple<Fields...>;
+	inline static constexpr index_t no_index = std::numeric_limits<index_t>::max();
+
+	template<size_t I>
+	using field_t = std::tuple_element_t<I, fields_t>;
+
+	std::tuple<Fields*...> columns;
+	std::unique_ptr<index_t[]> next; // free list links
+	index_t first_free;
+	index_t size_;
+	index_t capacity_;
+	std::vector<std::uint64_t> occupied; // bit per slot, set while live
+
+	static size_t checked(size_t capacity)
+	{
+		if (no_index <= capacity)
+			throw std::invalid_argument("soa_pool capacity too big for its index type");
+		return capacity;
+	}
+
+	basic_soa_pool(size_t capacity)
+		: next(new index_t[checked(capacity)])
+		, first_free(capacity == 0 ? no_index : 0)
+		, size_(0)
+		, capacity_(capacity)
+		, occupied((capacity + 63) / 64, 0)
+	{
+		try {
+			std::apply([&](auto *&...column)
+				{
+					(allocate_column(column), ...);
+				}, columns);
+		} catch (...) {
+			deallocate_columns(); // the ones allocated so far, the others are null
+			throw;
+		}
+		for (index_t i=0 ; i<capacity_ ; ++i)
+			next[i] = i+1 == capacity_ ? no_index : i+1;
+	}
+	basic_soa_pool(const basic_soa_pool &) = delete;
+	~basic_soa_pool()
+	{
+		for_each_index([&](index_t idx){ destroy(idx, std::index_sequence_for<Fields...>()); });
+		deallocate_columns();
+	}
+
+	template<typename F>
+	void allocate_column(F *& column)
+	{
+		column = (F*) Storage::allocate_bytes(sizeof(F) * capacity_);
+		if ( ! column && capacity_ != 0)
+			throw std::bad_alloc();
+	}
+	void deallocate_columns()
+	{
+		std::apply([&](auto *...column)
+			{
+				((column ? Storage::deallocate_bytes(column, sizeof(*column) * capacity_) : void()), ...);
+			}, columns);
+	}
+
+	size_t size() const { return size_; }
+	size_t capacity() const { return capacity_; }
+	bool empty() const { return size_ == 0; }
+	bool full() const { return size_ == capacity_; }
+
+	bool is_live(index_t idx) const { return (occupied[idx / 64] >> (idx % 64)) & 1; }
+
+	// slot of the new object, no_index when full.
+	// Either no argument, and all fields are value-initialized, or one per field.
+	// The slot is taken once all fields are built: if one throws, those built
+	// before it are destroyed and the pool is as it was.
+	template<typename...Args>
+	index_t alloc(Args&&...args)
+	{
+		static_assert(sizeof...(Args) == 0 || sizeof...(Args) == sizeof...(Fields), "soa_pool::alloc() takes no value or one per field");
+		if (full())
+			return no_index;
+		index_t idx = first_free;
+		construct(idx, std::index_sequence_for<Fields...>(), std::forward<Args>(args)...);
+		first_free = next[idx];
+		++size_;
+		occupied[idx / 64] |= std::uint64_t(1) << (idx % 64);
+		return idx;
+	}
+	template<size_t...I, typename...Args>
+	void construct(index_t idx, std::index_sequence<I...>, Args&&...args)
+	{
+		size_t built = 0;
+		try {
+			if constexpr (sizeof...(Args) == 0)
+				((new (&std::get<I>(columns)[idx]) field_t<I>(), ++built), ...);
+			else
+				((new (&std::get<I>(columns)[idx]) field_t<I>(std::forward<Args>(args)), ++built), ...);
+		} catch (...) {
+			((I < built ? std::get<I>(columns)[idx].~field_t<I>() : void()), ...);
+			throw;
+		}
+	}
+	template<size_t...I>
+	void destroy(index_t idx, std::index_sequence<I...>)
+	{
+		(std::get<I>(columns)[idx].~field_t<I>(), ...);
+	}
+
+	void free(index_t idx)
+	{
+		assert(is_live(idx));
+		destroy(idx, std::index_sequence_for<Fields...>());
+		occupied[idx / 64] &= ~(std::uint64_t(1) << (idx % 64));
+		next[idx] = first_free;
+		first_free = idx;
+		--size_;
+	}
+
+	template<size_t I>       field_t<I> & get(index_t idx)       { return std::get<I>(columns)[idx]; }
+	template<size_t I> const field_t<I> & get(index_t idx) const { return std::get<I>(columns)[idx]; }
+
+	// the whole array of field I, capacity() long, live or not
+	template<size_t I>       field_t<I> * column()       { return std::get<I>(columns); }
+	template<size_t I> const field_t<I> * column() const { return std::get<I>(columns); }
+
+	// f(idx) for each live slot, in index order
+	template<typename F>
+	void for_each_index(F f) const
+	{
+		for (size_t w=0 ; w<occupied.size() ; w++)
+			for (std::uint64_t bits = occupied[w] ; bits != 0 ; bits &= bits - 1)
+				f(index_t(w * 64 + __builtin_ctzll(bits)));
+	}
+};
+
+template<typename...Fields>
+using soa_pool = basic_soa_pool<heap_storage, Fields...>;
+
+} // namespace
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <type_traits>
+#include <memory_resource>
 
 #include "utttil/string_list.hpp"
 
@@ -12,8 +13,10 @@ template<typename Device>
 struct to_json
 {
 	Device write;
-	to_json(Device d)
+	std::pmr::memory_resource * memory; // for temporaries, e.g. a utttil::arena_resource
+	to_json(Device d, std::pmr::memory_resource * memory_ = std::pmr::get_default_resource())
 		:write(std::move(d))
+		,memory(memory_)
 	{}
 };
 
@@ -26,6 +29,14 @@ to_json<Device> & operator<<(to_json<Device> & serializer, std::string s)
 	serializer.write("\"");
 	return serializer;
 }
+template<typename Device>
+to_json<Device> & operator<<(to_json<Device> & serializer, const std::pmr::string & s)
+{
+	serializer.write("\"");
+	serializer.write(s);
+	serializer.write("\"");
+	return serializer;
+}
 // integral (to_string exists)
 //template<typename B, typename T, typename = decltype( std::to_string(std::declval<T>()) )>
 template<typename Device, typename T, typename std::enable_if<std::is_integral<T>{},int>::type = 0>
@@ -41,10 +52,10 @@ template<typename Device
 	>
 to_json<Device> & operator<<(to_json<Device> & serializer, const T & t)
 {
-	utttil::string_list names;
-	t.serialize_names(device::stream_to_lambda([&](std::string v)
+	utttil::pmr::string_list names(serializer.memory);
+	t.serialize_names(device::stream_to_lambda([&](const std::string & v)
 		{
-			names.push_back(std::move(v));
+			names.emplace_back(v);
 		}));
 
 	bool comma = false;
@@ -0,0 +1,176 @@
+
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <string>
+
+namespace utttil {
+
+// Storage policies allocate the element array of a ring, or the raw cells
+// of a pool through allocate_bytes().
+// mirrored == true means [data, data + 2*capacity) is virtually contiguous
+// and element i is also visible at data[i + capacity].
+
+struct heap_storage
+{
+	inline static constexpr bool mirrored = false;
+
+	static void * allocate_bytes(size_t bytes)
+	{
+		return ::malloc(bytes);
+	}
+	static void deallocate_bytes(void * p, size_t)
+	{
+		::free(p);
+	}
+
+	template<typename T>
+	static T * allocate(size_t capacity)
+	{
+		return new T[capacity];
+	}
+	template<typename T>
+	static void deallocate(T * data, size_t)
+	{
+		delete[] data;
+	}
+};
+
+// Maps the same memfd twice back to back so that nothing ever wraps.
+// The byte size must be a multiple of the page size.
+struct mirrored_storage
+{
+	inline static constexpr bool mirrored = true;
+
+	template<typename T>
+	static T * allocate(size_t capacity)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "mirrored_storage needs trivially copyable elements");
+
+		size_t bytes = capacity * sizeof(T);
+		if (bytes % ::sysconf(_SC_PAGESIZE) != 0)
+			throw std::invalid_argument("mirrored_storage size must be a multiple of the page size");
+
+		int fd = ::memfd_create("utttil::mirrored_storage", MFD_CLOEXEC);
+		if (fd == -1)
+			throw std::bad_alloc();
+		if (::ftruncate(fd, bytes) != 0)
+		{
+			::close(fd);
+			throw std::bad_alloc();
+		}
+		// reserve both halves first so that nobody else can map in between
+		char * base = (char*) ::mmap(nullptr, 2*bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED)
+		{
+			::close(fd);
+			throw std::bad_alloc();
+		}
+		if (   ::mmap(base        , bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+		    || ::mmap(base + bytes, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		{
+			::munmap(base, 2*bytes);
+			::close(fd);
+			throw std::bad_alloc();
+		}
+		::close(fd); // the mappings keep it alive
+
+		T * data = (T*) base;
+		std::uninitialized_default_construct_n(data, capacity);
+		return data;
+	}
+	template<typename T>
+	static void deallocate(T * data, size_t capacity)
+	{
+		if (data != nullptr)
+			::munmap(data, 2 * capacity * sizeof(T));
+	}
+};
+
+enum mmap_storage_options
+{
+	huge_pages = 1, // MAP_HUGETLB, or transparent huge pages if none are reserved
+	prefault   = 2, // every page is faulted in by the constructor
+};
+
+// Anonymous mapping, optionally on huge pages, bound to a NUMA node
+// (Node >= 0) and prefaulted, so that the page faults and TLB misses happen
+// at startup rather than on the hot path.
+template<int Options=huge_pages|prefault, int Node=-1>
+struct mmap_storage
+{
+	inline static constexpr bool mirrored = false;
+	inline static constexpr size_t huge_page_size = 2*1024*1024;
+
+	static size_t mapped_size(size_t bytes)
+	{
+		size_t page = (Options & huge_pages) ? huge_page_size : ::sysconf(_SC_PAGESIZE);
+		return (bytes + page - 1) / page * page;
+	}
+
+	static void * allocate_bytes(size_t bytes)
+	{
+		if (bytes == 0)
+			return nullptr;
+		size_t size = mapped_size(bytes);
+		// MAP_POPULATE would fault pages in before mbind() could place them
+		int populate = ((Options & prefault) && Node < 0) ? MAP_POPULATE : 0;
+		void * p = MAP_FAILED;
+		if (Options & huge_pages)
+			p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate, -1, 0);
+		if (p == MAP_FAILED)
+		{
+			p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | populate, -1, 0);
+			if (p == MAP_FAILED)
+				throw std::bad_alloc();
+			if (Options & huge_pages)
+				::madvise(p, size, MADV_HUGEPAGE);
+		}
+		if constexpr (Node >= 0)
+		{
+			unsigned long nodemask[(Node + 64) / 64] = {};
+			nodemask[Node / 64] = 1ul << (Node % 64);
+			if (::syscall(SYS_mbind, p, size, MPOL_BIND, nodemask, Node + 2, MPOL_MF_MOVE) != 0)
+			{
+				::munmap(p, size);
+				throw std::runtime_error("mmap_storage: mbind() to node " + std::to_string(Node) + " failed");
+			}
+			if (Options & prefault)
+				for (size_t i=0 ; i<size ; i+=::sysconf(_SC_PAGESIZE))
+					((volatile char*)p)[i] = 0;
+		}
+		return p;
+	}
+	static void deallocate_bytes(void * p, size_t bytes)
+	{
+		if (p != nullptr)
+			::munmap(p, mapped_size(bytes));
+	}
+
+	template<typename T>
+	static T * allocate(size_t capacity)
+	{
+		T * data = (T*) allocate_bytes(capacity * sizeof(T));
+		std::uninitialized_default_construct_n(data, capacity);
+		return data;
+	}
+	template<typename T>
+	static void deallocate(T * data, size_t capacity)
+	{
+		if (data == nullptr)
+			return;
+		std::destroy_n(data, capacity);
+		deallocate_bytes(data, capacity * sizeof(T));
+	}
+};
+
+} // namespace
@@ -3,6 +3,8 @@
 
 #include <deque>
 #include <string>
+#include <string_view>
+#include <memory_resource>
 #include <utility>
 #include <type_traits>
 
@@ -10,6 +12,14 @@ namespace utttil {
 
 struct string_list : std::deque<std::string> {};
 
+namespace pmr {
+// same, allocating from a memory_resource, e.g. a utttil::arena_resource
+struct string_list : std::pmr::deque<std::pmr::string>
+{
+	using std::pmr::deque<std::pmr::string>::deque;
+};
+} // namespace
+
 } // namespace
 
 template<typename T, typename = decltype( std::to_string(std::declval<T>()) )>
@@ -22,4 +32,15 @@ inline utttil::string_list & operator<<(utttil::string_list & sl, std::string s)
 {
 	sl.push_back(std::move(s));
 	return sl;
-}
\ No newline at end of file
+}
+template<typename T, typename = decltype( std::to_string(std::declval<T>()) )>
+utttil::pmr::string_list & operator<<(utttil::pmr::string_list & sl, T && s)
+{
+	sl.emplace_back(std::to_string(s));
+	return sl;
+}
+inline utttil::pmr::string_list & operator<<(utttil::pmr::string_list & sl, std::string_view s)
+{
+	sl.emplace_back(s);
+	return sl;
+}
@@ -0,0 +1,88 @@
+
+#pragma once
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <immintrin.h>
+
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+namespace utttil {
+
+// Wait policies tell a blocking accessor how to wait for an index owned by
+// the other side to move, and the other side how to wake it up.
+// Each policy has a per-index state living next to the index it watches.
+
+// Burns the core, lowest latency. Notifying is free.
+struct spin_wait
+{
+	struct state {};
+
+	template<typename Blocked>
+	static inline void wait(const std::atomic<size_t> &, state &, Blocked blocked)
+	{
+		while (blocked())
+			_mm_pause();
+	}
+	static inline void notify(const std::atomic<size_t> &, state &) {}
+};
+
+// Spins, then yields, then parks on a futex keyed on the index.
+// The notifier only makes a syscall when a waiter is parked.
+template<size_t Spins=1024, size_t Yields=64>
+struct park_wait
+{
+	struct state
+	{
+		std::atomic<std::uint32_t> waiters = 0;
+	};
+
+	// futexes are 32 bits, the low half of the index is what moves (x86 is little endian)
+	static inline std::uint32_t * futex_word(const std::atomic<size_t> & index)
+	{
+		return (std::uint32_t*) &index;
+	}
+
+	template<typename Blocked>
+	static inline void wait(const std::atomic<size_t> & index, state & s, Blocked blocked)
+	{
+		for (size_t i=0 ; i<Spins ; i++)
+		{
+			if ( ! blocked())
+				return;
+			_mm_pause();
+		}
+		for (size_t i=0 ; i<Yields ; i++)
+		{
+			if ( ! blocked())
+				return;
+			std::this_thread::yield();
+		}
+		for (;;)
+		{
+			std::uint32_t observed = (std::uint32_t) index.load(std::memory_order_acquire);
+			s.waiters.fetch_add(1, std::memory_order_seq_cst);
+			// pairs with the fence in notify(): either we see the new index or the notifier sees us
+			if ( ! blocked())
+			{
+				s.waiters.fetch_sub(1, std::memory_order_relaxed);
+				return;
+			}
+			::syscall(SYS_futex, futex_word(index), FUTEX_WAIT_PRIVATE, observed, nullptr, nullptr, 0);
+			s.waiters.fetch_sub(1, std::memory_order_relaxed);
+			if ( ! blocked())
+				return;
+		}
+	}
+	static inline void notify(const std::atomic<size_t> & index, state & s)
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (s.waiters.load(std::memory_order_relaxed) != 0)
+			::syscall(SYS_futex, futex_word(index), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+	}
+};
+
+} // namespace